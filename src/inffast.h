@@ -0,0 +1,18 @@
+/* inffast.h -- header to use inffast.c
+ * Copyright (C) 1995-2003, 2010 Mark Adler
+ * Copyright (C) 2026 Gildas Lormeau (deflate64 support)
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/* Input bytes that inflate() must have to call state->fast(): enough for the
+   longest length/distance pair, as zlib for deflate, and for deflate64 */
+#define FAST_MIN_IN 6
+#define FAST_MIN_IN9 8
+
+void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start);
+void ZLIB_INTERNAL inflate_fast9(z_streamp strm, unsigned start);
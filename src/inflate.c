@@ -7,7 +7,8 @@
  * with inflateInit2(strm, -16).  The deflate64 mode uses a 64K sliding
  * window, the extended length code 285 (16 extra bits, base 3) and the two
  * extra distance codes 30 and 31, as decoded by the tables that
- * inflate_table() builds when its deflate64 argument is set.  BUILDFIXED is
+ * inflate_table() builds when its deflate64 argument is set, and by its own
+ * fast loop, inflate_fast9(), selected in inflateReset2().  BUILDFIXED is
  * forced below because both fixed-code table sets are built at run time.
  */
 
@@ -129,6 +130,7 @@ int ZEXPORT inflateResetKeep(z_streamp strm) {
     state->lencode = state->distcode = state->next = state->codes;
     state->sane = 1;
     state->back = -1;
+    state->behind = 0;
     Tracev((stderr, "inflate: reset\n"));
     return Z_OK;
 }
@@ -180,6 +182,8 @@ int ZEXPORT inflateReset2(z_streamp strm, int windowBits) {
     /* update state and reset the rest of it */
     state->wrap = wrap;
     state->wbits = (unsigned)windowBits;
+    state->fast = state->deflate64 ? inflate_fast9 : inflate_fast;
+    state->fast_in = state->deflate64 ? FAST_MIN_IN9 : FAST_MIN_IN;
     return inflateReset(strm);
 }
 
@@ -214,6 +218,13 @@ int ZEXPORT inflateInit2_(z_streamp strm, int windowBits,
     strm->state = (struct internal_state FAR *)state;
     state->strm = strm;
     state->window = Z_NULL;
+    state->ring = 0;
+#if TABLE_CACHE > 0
+    state->tables = Z_NULL;
+    zmemzero(state->recent, sizeof(state->recent));
+    state->turn = 0;
+#endif
+    INFSTAT(zmemzero(&state->stats, sizeof(inf_stats)));
     state->mode = HEAD;     /* to pass state test in inflateReset2() */
     ret = inflateReset2(strm, windowBits);
     if (ret != Z_OK) {
@@ -371,6 +382,12 @@ void makefixed(void)
    upon return from inflate(), and since all distances after the first 32K of
    output will fall in the output data, making match copies simpler and faster.
    The advantage may be dependent on the size of the processor's data caches.
+
+   The window is not circular: it holds twice wsize bytes, the last whave bytes
+   of output end at wnext, and they are moved to the start of the window when
+   there is no room behind them.  A match that starts in the window then reads
+   it in one piece.  The move copies at most as many bytes as were appended
+   since the previous one.
  */
 local int updatewindow(z_streamp strm, const Bytef *end, unsigned copy) {
     struct inflate_state FAR *state;
@@ -381,7 +398,7 @@ local int updatewindow(z_streamp strm, const Bytef *end, unsigned copy) {
     /* if it hasn't been done already, allocate space for the window */
     if (state->window == Z_NULL) {
         state->window = (unsigned char FAR *)
-                        ZALLOC(strm, 1U << state->wbits,
+                        ZALLOC(strm, 2U << state->wbits,
                                sizeof(unsigned char));
         if (state->window == Z_NULL) return 1;
     }
@@ -393,28 +410,145 @@ local int updatewindow(z_streamp strm, const Bytef *end, unsigned copy) {
         state->whave = 0;
     }
 
-    /* copy state->wsize or less output bytes into the circular window */
+    INFSTAT(state->stats.window_copies++);
+    INFSTAT(state->stats.window_bytes += copy < state->wsize ?
+                                         copy : state->wsize);
+
+    /* copy state->wsize or less output bytes behind the window bytes */
     if (copy >= state->wsize) {
         zmemcpy(state->window, end - state->wsize, state->wsize);
-        state->wnext = 0;
+        state->wnext = state->wsize;
         state->whave = state->wsize;
     }
     else {
-        dist = state->wsize - state->wnext;
-        if (dist > copy) dist = copy;
-        zmemcpy(state->window + state->wnext, end - copy, dist);
-        copy -= dist;
-        if (copy) {
-            zmemcpy(state->window, end - copy, copy);
-            state->wnext = copy;
-            state->whave = state->wsize;
+        if (copy > 2 * state->wsize - state->wnext) {
+            /* move the bytes still needed to the start, which they do not
+               overlap */
+            dist = state->wsize - copy;
+            if (dist > state->whave) dist = state->whave;
+            INFSTAT(state->stats.window_bytes += dist);
+            zmemcpy(state->window, state->window + state->wnext - dist, dist);
+            state->wnext = dist;
+            state->whave = dist;
+        }
+        zmemcpy(state->window + state->wnext, end - copy, copy);
+        state->wnext += copy;
+        state->whave += copy;
+        if (state->whave > state->wsize) state->whave = state->wsize;
+    }
+    return 0;
+}
+
+#if TABLE_CACHE > 0
+/* true if the table pointer p points in the table cache of state */
+#  define IN_CACHE(state, p) \
+    ((state)->tables != Z_NULL && \
+     (char FAR *)(p) >= (char FAR *)(state)->tables && \
+     (char FAR *)(p) < (char FAR *)((state)->tables + TABLE_CACHE))
+#endif
+
+/*
+   Build the length/literal and distance code tables of a dynamic block from
+   the code lengths in state->lens[].  Return 0, or 1 if the length/literal
+   code lengths are invalid, 2 if the distance ones are.
+
+   The tables of the last TABLE_CACHE headers are kept, and a header that
+   repeats one of them reuses its tables instead of building them again:
+   streams of small messages, each ending with a flush, often send the same
+   header many times.  The cache is allocated once a header has repeated, so
+   that streams that never repeat one do without it.  A header matches only
+   if its code lengths are the same, the hash sorting out most misses.
+ */
+local int build_tables(struct inflate_state FAR *state) {
+    int ret;
+#if TABLE_CACHE > 0
+    table_entry FAR *entry = Z_NULL;
+    unsigned long hash;
+    unsigned n, count;
+
+    /* find the code lengths in the cache */
+    count = state->nlen + state->ndist;
+    hash = ((unsigned long)state->nlen << 6) + state->ndist +
+           ((unsigned long)state->deflate64 << 12);
+    for (n = 0; n < count; n++)
+        hash = hash * 31 + state->lens[n];
+    if (hash == 0) hash = 1;
+    if (state->tables == Z_NULL) {
+        for (n = 0; n < TABLE_CACHE; n++)
+            if (state->recent[n] == hash) break;
+        if (n < TABLE_CACHE) {
+            state->tables = (table_entry FAR *)
+                ZALLOC(state->strm, TABLE_CACHE, sizeof(table_entry));
+            if (state->tables != Z_NULL)
+                for (n = 0; n < TABLE_CACHE; n++)
+                    state->tables[n].hash = 0;
         }
-        else {
-            state->wnext += dist;
-            if (state->wnext == state->wsize) state->wnext = 0;
-            if (state->whave < state->wsize) state->whave += dist;
+        else
+            state->recent[state->turn] = hash;
+    }
+    else {
+        for (n = 0; n < TABLE_CACHE; n++) {
+            entry = state->tables + n;
+            if (entry->hash == hash && entry->nlen == state->nlen &&
+                entry->ndist == state->ndist &&
+                entry->deflate64 == state->deflate64) {
+                for (count = 0; count < entry->nlen + entry->ndist; count++)
+                    if (entry->lens[count] != state->lens[count]) break;
+                if (count == entry->nlen + entry->ndist) {
+                    state->lencode = (const code FAR *)(entry->codes);
+                    state->lenbits = entry->lenbits;
+                    state->distcode =
+                        (const code FAR *)(entry->codes + entry->dist);
+                    state->distbits = entry->distbits;
+                    state->next = entry->codes + entry->used;
+                    INFSTAT(state->stats.cached++);
+                    return 0;
+                }
+            }
         }
     }
+    if (state->tables != Z_NULL) {
+        /* build the tables in place of the oldest ones */
+        entry = state->tables + state->turn;
+        entry->hash = 0;
+        state->next = entry->codes;
+    }
+    else
+        state->next = state->codes;
+    state->turn = (state->turn + 1) % TABLE_CACHE;
+#else
+    state->next = state->codes;
+#endif
+
+    /* note: the lenbits and distbits values here are chosen in inftrees.h,
+       along with the ENOUGH constants, which depend on those values */
+    state->lencode = (const code FAR *)(state->next);
+    state->lenbits = INFLATE_LEN_ROOT;
+    INFSTAT(state->stats.tables++);
+    ret = inflate_table(LENS, state->lens, state->nlen, &(state->next),
+                        &(state->lenbits), state->work, state->deflate64);
+    if (ret) return 1;
+    state->distcode = (const code FAR *)(state->next);
+    state->distbits = INFLATE_DIST_ROOT;
+    INFSTAT(state->stats.tables++);
+    ret = inflate_table(DISTS, state->lens + state->nlen, state->ndist,
+                        &(state->next), &(state->distbits), state->work,
+                        state->deflate64);
+    if (ret) return 2;
+#if TABLE_CACHE > 0
+    if (entry != Z_NULL) {
+        entry->nlen = state->nlen;
+        entry->ndist = state->ndist;
+        entry->deflate64 = state->deflate64;
+        entry->lenbits = state->lenbits;
+        entry->distbits = state->distbits;
+        entry->dist = (unsigned)(state->distcode - entry->codes);
+        entry->used = (unsigned)(state->next - entry->codes);
+        for (n = 0; n < entry->nlen + entry->ndist; n++)
+            entry->lens[n] = (unsigned char)state->lens[n];
+        entry->hash = hash;
+    }
+#endif
     return 0;
 }
 
@@ -844,12 +978,14 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             case 0:                             /* stored block */
                 Tracev((stderr, "inflate:     stored block%s\n",
                         state->last ? " (last)" : ""));
+                INFSTAT(state->stats.stored++);
                 state->mode = STORED;
                 break;
             case 1:                             /* fixed block */
                 fixedtables(state);
                 Tracev((stderr, "inflate:     fixed codes block%s\n",
                         state->last ? " (last)" : ""));
+                INFSTAT(state->stats.fixed++);
                 state->mode = LEN_;             /* decode codes */
                 if (flush == Z_TREES) {
                     DROPBITS(2);
@@ -859,6 +995,7 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             case 2:                             /* dynamic block */
                 Tracev((stderr, "inflate:     dynamic codes block%s\n",
                         state->last ? " (last)" : ""));
+                INFSTAT(state->stats.dynamic++);
                 state->mode = TABLE;
                 break;
             case 3:
@@ -933,6 +1070,7 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             state->next = state->codes;
             state->lencode = state->distcode = (const code FAR *)(state->next);
             state->lenbits = 7;
+            INFSTAT(state->stats.tables++);
             ret = inflate_table(CODES, state->lens, 19, &(state->next),
                                 &(state->lenbits), state->work,
                                 state->deflate64);
@@ -1003,27 +1141,12 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
                 break;
             }
 
-            /* build code tables -- note: do not change the lenbits or distbits
-               values here (9 and 6) without reading the comments in inftrees.h
-               concerning the ENOUGH constants, which depend on those values */
-            state->next = state->codes;
-            state->lencode = (const code FAR *)(state->next);
-            state->lenbits = 9;
-            ret = inflate_table(LENS, state->lens, state->nlen, &(state->next),
-                                &(state->lenbits), state->work,
-                                state->deflate64);
+            /* build code tables, or find them in the cache */
+            ret = build_tables(state);
             if (ret) {
-                strm->msg = (z_const char *)"invalid literal/lengths set";
-                state->mode = BAD;
-                break;
-            }
-            state->distcode = (const code FAR *)(state->next);
-            state->distbits = 6;
-            ret = inflate_table(DISTS, state->lens + state->nlen, state->ndist,
-                            &(state->next), &(state->distbits), state->work,
-                            state->deflate64);
-            if (ret) {
-                strm->msg = (z_const char *)"invalid distances set";
+                strm->msg = ret == 1 ?
+                    (z_const char *)"invalid literal/lengths set" :
+                    (z_const char *)"invalid distances set";
                 state->mode = BAD;
                 break;
             }
@@ -1035,9 +1158,9 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             state->mode = LEN;
                 /* fallthrough */
         case LEN:
-            if (!state->deflate64 && have >= 6 && left >= 258) {
+            if (have >= state->fast_in && left >= 258) {
                 RESTORE();
-                inflate_fast(strm, out);
+                state->fast(strm, out);
                 LOAD();
                 if (state->mode == TYPE)
                     state->back = -1;
@@ -1063,6 +1186,7 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             DROPBITS(here.bits);
             state->back += here.bits;
             state->length = (unsigned)here.val;
+            INFSTAT(state->stats.slow++);
             if ((int)(here.op) == 0) {
                 Tracevv((stderr, here.val >= 0x20 && here.val < 0x7f ?
                         "inflate:         literal '%c'\n" :
@@ -1138,11 +1262,12 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
             }
 #endif
             Tracevv((stderr, "inflate:         distance %u\n", state->offset));
+            INFSTAT_MATCH(state->stats, state->length, state->offset);
             state->mode = MATCH;
                 /* fallthrough */
         case MATCH:
             if (left == 0) goto inf_leave;
-            copy = out - left;
+            copy = out - left + state->behind;
             if (state->offset > copy) {         /* copy from window */
                 copy = state->offset - copy;
                 if (copy > state->whave) {
@@ -1165,12 +1290,7 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
                     break;
 #endif
                 }
-                if (copy > state->wnext) {
-                    copy -= state->wnext;
-                    from = state->window + (state->wsize - copy);
-                }
-                else
-                    from = state->window + (state->wnext - copy);
+                from = state->window + (state->wnext - copy);
                 if (copy > state->length) copy = state->length;
             }
             else {                              /* copy from output */
@@ -1252,8 +1372,9 @@ int ZEXPORT inflate(z_streamp strm, int flush) {
      */
   inf_leave:
     RESTORE();
-    if (state->wsize || (out != strm->avail_out && state->mode < BAD &&
-            (state->mode < CHECK || flush != Z_FINISH)))
+    if (!state->ring &&
+        (state->wsize || (out != strm->avail_out && state->mode < BAD &&
+            (state->mode < CHECK || flush != Z_FINISH))))
         if (updatewindow(strm, strm->next_out, out - strm->avail_out)) {
             state->mode = MEM;
             return Z_MEM_ERROR;
@@ -1280,6 +1401,9 @@ int ZEXPORT inflateEnd(z_streamp strm) {
         return Z_STREAM_ERROR;
     state = (struct inflate_state FAR *)strm->state;
     if (state->window != Z_NULL) ZFREE(strm, state->window);
+#if TABLE_CACHE > 0
+    if (state->tables != Z_NULL) ZFREE(strm, state->tables);
+#endif
     ZFREE(strm, strm->state);
     strm->state = Z_NULL;
     Tracev((stderr, "inflate: end\n"));
@@ -1296,10 +1420,8 @@ int ZEXPORT inflateGetDictionary(z_streamp strm, Bytef *dictionary,
 
     /* copy dictionary */
     if (state->whave && dictionary != Z_NULL) {
-        zmemcpy(dictionary, state->window + state->wnext,
-                state->whave - state->wnext);
-        zmemcpy(dictionary + state->whave - state->wnext,
-                state->window, state->wnext);
+        zmemcpy(dictionary, state->window + state->wnext - state->whave,
+                state->whave);
     }
     if (dictLength != Z_NULL)
         *dictLength = state->whave;
@@ -1315,7 +1437,7 @@ int ZEXPORT inflateSetDictionary(z_streamp strm, const Bytef *dictionary,
     /* check state */
     if (inflateStateCheck(strm)) return Z_STREAM_ERROR;
     state = (struct inflate_state FAR *)strm->state;
-    if (state->wrap != 0 && state->mode != DICT)
+    if ((state->wrap != 0 && state->mode != DICT) || state->ring)
         return Z_STREAM_ERROR;
 
     /* check for correct dictionary identifier */
@@ -1352,6 +1474,39 @@ int ZEXPORT inflateGetHeader(z_streamp strm, gz_headerp head) {
     return Z_OK;
 }
 
+int ZEXPORT inflateGetStats(z_streamp strm, inf_stats FAR *stats) {
+#ifdef INFLATE_STATS
+    struct inflate_state FAR *state;
+
+    /* check state */
+    if (inflateStateCheck(strm) || stats == Z_NULL) return Z_STREAM_ERROR;
+    state = (struct inflate_state FAR *)strm->state;
+
+    /* copy counters */
+    zmemcpy(stats, &state->stats, sizeof(inf_stats));
+    return Z_OK;
+#else
+    (void)strm;
+    (void)stats;
+    return Z_STREAM_ERROR;
+#endif
+}
+
+int ZEXPORT inflateRing(z_streamp strm, unsigned behind) {
+    struct inflate_state FAR *state;
+
+    /* check state: a window cannot be given up once in use */
+    if (inflateStateCheck(strm)) return Z_STREAM_ERROR;
+    state = (struct inflate_state FAR *)strm->state;
+    if (!state->ring && (state->window != Z_NULL || strm->total_out))
+        return Z_STREAM_ERROR;
+
+    /* matches reach into the behind bytes instead of a window from now on */
+    state->ring = 1;
+    state->behind = behind;
+    return Z_OK;
+}
+
 /*
    Search buf[0..len-1] for the pattern: 0, 0, 0xff, 0xff.  Return when found
    or when out of input.  When called, *have is the number of pattern bytes
@@ -1451,7 +1606,9 @@ int ZEXPORT inflateCopy(z_streamp dest, z_streamp source) {
     struct inflate_state FAR *state;
     struct inflate_state FAR *copy;
     unsigned char FAR *window;
-    unsigned wsize;
+#if TABLE_CACHE > 0
+    table_entry FAR *tables;
+#endif
 
     /* check input */
     if (inflateStateCheck(source) || dest == Z_NULL)
@@ -1465,12 +1622,24 @@ int ZEXPORT inflateCopy(z_streamp dest, z_streamp source) {
     window = Z_NULL;
     if (state->window != Z_NULL) {
         window = (unsigned char FAR *)
-                 ZALLOC(source, 1U << state->wbits, sizeof(unsigned char));
+                 ZALLOC(source, 2U << state->wbits, sizeof(unsigned char));
         if (window == Z_NULL) {
             ZFREE(source, copy);
             return Z_MEM_ERROR;
         }
     }
+#if TABLE_CACHE > 0
+    tables = Z_NULL;
+    if (state->tables != Z_NULL) {
+        tables = (table_entry FAR *)
+                 ZALLOC(source, TABLE_CACHE, sizeof(table_entry));
+        if (tables == Z_NULL) {
+            if (window != Z_NULL) ZFREE(source, window);
+            ZFREE(source, copy);
+            return Z_MEM_ERROR;
+        }
+    }
+#endif
 
     /* copy state */
     zmemcpy((voidpf)dest, (voidpf)source, sizeof(z_stream));
@@ -1482,10 +1651,22 @@ int ZEXPORT inflateCopy(z_streamp dest, z_streamp source) {
         copy->distcode = copy->codes + (state->distcode - state->codes);
     }
     copy->next = copy->codes + (state->next - state->codes);
-    if (window != Z_NULL) {
-        wsize = 1U << state->wbits;
-        zmemcpy(window, state->window, wsize);
+#if TABLE_CACHE > 0
+    if (tables != Z_NULL) {
+        zmemcpy(tables, state->tables, TABLE_CACHE * sizeof(table_entry));
+        if (IN_CACHE(state, state->lencode)) {
+            copy->lencode = (const code FAR *)((char FAR *)tables +
+                ((char FAR *)state->lencode - (char FAR *)state->tables));
+            copy->distcode = (const code FAR *)((char FAR *)tables +
+                ((char FAR *)state->distcode - (char FAR *)state->tables));
+            copy->next = (code FAR *)((char FAR *)tables +
+                ((char FAR *)state->next - (char FAR *)state->tables));
+        }
     }
+    copy->tables = tables;
+#endif
+    if (window != Z_NULL)
+        zmemcpy(window, state->window, state->wnext);
     copy->window = window;
     dest->state = (struct internal_state FAR *)copy;
     return Z_OK;
@@ -1533,5 +1714,11 @@ unsigned long ZEXPORT inflateCodesUsed(z_streamp strm) {
     struct inflate_state FAR *state;
     if (inflateStateCheck(strm)) return (unsigned long)-1;
     state = (struct inflate_state FAR *)strm->state;
+#if TABLE_CACHE > 0
+    if (IN_CACHE(state, state->next))
+        return (unsigned long)(state->next - state->tables[
+            ((char FAR *)state->next - (char FAR *)state->tables) /
+            sizeof(table_entry)].codes);
+#endif
     return (unsigned long)(state->next - state->codes);
 }
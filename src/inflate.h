@@ -17,6 +17,8 @@
 #  define GUNZIP
 #endif
 
+#include "infstats.h"
+
 /* Possible inflate modes between inflate() calls */
 typedef enum {
     HEAD = 16180,   /* i: waiting for magic header */
@@ -78,8 +80,34 @@ typedef enum {
         CHECK -> LENGTH -> DONE
  */
 
+/* Number of dynamic block code tables kept for headers that repeat (see
+   build_tables() in inflate.c), or 0 for none.  The cache is allocated when a
+   header first repeats.  An entry holds ENOUGH codes of 4 bytes and the code
+   lengths: about 6K bytes with the default roots (9 and 6, see inftrees.h),
+   7K with the wasm build's (10 and 8), so 28K for its 4 entries. */
+#ifndef TABLE_CACHE
+#  define TABLE_CACHE 4
+#endif
+
+#if TABLE_CACHE > 0
+/* Code tables of a dynamic block header, for the table cache */
+typedef struct {
+    unsigned long hash;         /* hash of the code lengths, 0 if unused */
+    unsigned nlen;              /* number of length code lengths */
+    unsigned ndist;             /* number of distance code lengths */
+    int deflate64;              /* true if built for deflate64 */
+    unsigned lenbits;           /* index bits for the length/literal table */
+    unsigned distbits;          /* index bits for the distance table */
+    unsigned dist;              /* offset of the distance table in codes[] */
+    unsigned used;              /* number of codes used in codes[] */
+    unsigned char lens[320];    /* the code lengths */
+    code codes[ENOUGH];         /* length/literal table, then distance table */
+} table_entry;
+#endif
+
 /* State maintained between inflate() calls -- approximately 7K bytes, not
-   including the allocated sliding window, which is up to 32K bytes. */
+   including the allocated sliding window, which is up to twice 32K bytes (64K
+   for deflate64), and the table cache. */
 struct inflate_state {
     z_streamp strm;             /* pointer back to this zlib stream */
     inflate_mode mode;          /* current inflate mode */
@@ -97,8 +125,8 @@ struct inflate_state {
     unsigned wbits;             /* log base 2 of requested window size */
     unsigned wsize;             /* window size or zero if not using window */
     unsigned whave;             /* valid bytes in the window */
-    unsigned wnext;             /* window write index */
-    unsigned char FAR *window;  /* allocated sliding window, if needed */
+    unsigned wnext;             /* window write index, end of the valid bytes */
+    unsigned char FAR *window;  /* allocated sliding window, 2 * wsize bytes */
         /* bit accumulator */
     unsigned long hold;         /* input bit accumulator */
     unsigned bits;              /* number of bits in hold */
@@ -125,4 +153,28 @@ struct inflate_state {
     int back;                   /* bits back of last unprocessed length/lit */
     unsigned was;               /* initial length of match */
     int deflate64;              /* true when decoding raw deflate64 streams */
+    void (*fast)(z_streamp, unsigned);  /* inflate_fast() or inflate_fast9() */
+    unsigned fast_in;           /* input bytes it needs, FAST_MIN_IN(9) */
+    int ring;                   /* true in output ring mode: no window */
+    unsigned behind;            /* output ring: bytes before next_out */
+#if TABLE_CACHE > 0
+    table_entry FAR *tables;    /* table cache, or NULL until a repeat */
+    unsigned long recent[TABLE_CACHE];  /* hashes of the last headers seen
+                                           before the cache */
+    unsigned turn;              /* next cache entry (or hash) to replace */
+#endif
+#ifdef INFLATE_STATS
+    inf_stats stats;            /* instrumentation counters */
+#endif
 };
+
+/* Output ring mode: the caller keeps the previous output of the stream in
+   memory, and before each inflate() call gives the number of those bytes that
+   immediately precede strm->next_out: at least the window size, or all the
+   output since the last reset while there is less.  inflate() then
+   reads distances from there and keeps no window of its own, which saves
+   copying the output to the window at the end of each call.  The mode must be
+   set before the first output, and cannot be combined with a dictionary.  A
+   reset sets behind to zero until the next call of inflateRing().  Return
+   Z_STREAM_ERROR if the state is inconsistent or if a window is in use. */
+int ZEXPORT inflateRing(z_streamp strm, unsigned behind);
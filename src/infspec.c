@@ -0,0 +1,376 @@
+/* infspec.c -- speculative decoding of raw deflate data
+ * Copyright (C) 2026 Gildas Lormeau
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Decodes deflate blocks that start anywhere in a stream, without the 32K of
+ * output that precede them (the approach of pugz and rapidgzip).  A match
+ * that reaches before the decoded data yields markers instead of bytes, which
+ * the caller replaces once the preceding output is known.  When the position
+ * of a block is unknown, inflate_spec_find() tries every bit offset until a
+ * dynamic block header is valid and the whole block decodes without error.
+ * Only deflate is supported: the markers of a deflate64 window would not fit
+ * in 16 bits.
+ */
+
+#include "zutil.h"
+#include "inftrees.h"
+#include "infspec.h"
+
+/* Load local bit accumulator from the state at bit offset pos */
+#define LOAD(pos) \
+    do { \
+        next = s->in + ((pos) >> 3); \
+        hold = 0; \
+        bits = 0; \
+        if (next == end) goto more; \
+        hold = (unsigned long)(*next++) >> ((pos) & 7); \
+        bits = 8 - (unsigned)((pos) & 7); \
+    } while (0)
+
+/* Bit offset of the next unused bit */
+#define POS() ((unsigned long)(next - s->in) * 8 - bits)
+
+/* Get a byte of input into the bit accumulator, or return for more input */
+#define PULLBYTE() \
+    do { \
+        if (next == end) goto more; \
+        hold += (unsigned long)(*next++) << bits; \
+        bits += 8; \
+    } while (0)
+
+/* Assure that there are at least n bits in the bit accumulator */
+#define NEEDBITS(n) \
+    do { \
+        while (bits < (unsigned)(n)) \
+            PULLBYTE(); \
+    } while (0)
+
+/* Return the low n bits of the bit accumulator (n < 16) */
+#define BITS(n) \
+    ((unsigned)hold & ((1U << (n)) - 1))
+
+/* Remove n bits from the bit accumulator */
+#define DROPBITS(n) \
+    do { \
+        hold >>= (n); \
+        bits -= (unsigned)(n); \
+    } while (0)
+
+/* Return the fixed code tables, built on the first call with the state's
+   lens and work arrays (may not be thread safe, see fixedtables() in
+   inflate.c). */
+local void spec_fixed(spec_state FAR *s, const code FAR * FAR *lencode,
+                      const code FAR * FAR *distcode) {
+    static int virgin = 1;
+    static code *lenfix, *distfix;
+    static code fixed[544];
+
+    if (virgin) {
+        unsigned sym, bits;
+        code *next;
+
+        sym = 0;
+        while (sym < 144) s->lens[sym++] = 8;
+        while (sym < 256) s->lens[sym++] = 9;
+        while (sym < 280) s->lens[sym++] = 7;
+        while (sym < 288) s->lens[sym++] = 8;
+        next = fixed;
+        lenfix = next;
+        bits = 9;
+        inflate_table(LENS, s->lens, 288, &(next), &(bits), s->work, 0);
+
+        sym = 0;
+        while (sym < 32) s->lens[sym++] = 5;
+        distfix = next;
+        bits = 5;
+        inflate_table(DISTS, s->lens, 32, &(next), &(bits), s->work, 0);
+        virgin = 0;
+    }
+    *lencode = lenfix;
+    *distcode = distfix;
+}
+
+/*
+   Decode the block at s->pos and append its symbols to s->out.  On success,
+   s->pos is the offset of the following block and Z_OK is returned.  On
+   failure, nothing in the state changes except s->full: Z_DATA_ERROR is
+   returned for invalid data and Z_BUF_ERROR when the input ends or, with
+   s->full set, when s->out is full.  The checks are those of inflate(), with
+   incomplete code length codes rejected as in inflate_table().
+ */
+local int spec_block(spec_state FAR *s) {
+    static const unsigned short order[19] = /* permutation of code lengths */
+        {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    const unsigned char FAR *next;  /* next input byte */
+    const unsigned char FAR *end;   /* end of input */
+    unsigned long hold;         /* bit buffer */
+    unsigned bits;              /* bits in bit buffer */
+    unsigned short FAR *out;    /* decoded symbols */
+    unsigned long have;         /* symbols in out */
+    unsigned long markers;      /* matches that reached before out */
+    unsigned last, type;        /* block header */
+    const code FAR *lencode;    /* literal/length code table */
+    const code FAR *distcode;   /* distance code table */
+    unsigned lenbits;           /* index bits for lencode */
+    unsigned distbits;          /* index bits for distcode */
+    code here;                  /* current decoding table entry */
+    code prev;                  /* parent table entry */
+    unsigned op;                /* operation bits */
+    unsigned len;               /* match length, copy count */
+    unsigned dist;              /* match distance */
+    long from;                  /* position of the copied symbol */
+    unsigned copy;              /* number of symbols to copy */
+
+    end = s->in + s->len;
+    out = s->out;
+    have = s->have;
+    markers = s->markers;
+    LOAD(s->pos);
+    NEEDBITS(3);
+    last = BITS(1);
+    DROPBITS(1);
+    type = BITS(2);
+    DROPBITS(2);
+    switch (type) {
+    case 0:                                     /* stored block */
+        DROPBITS(bits & 7);
+        NEEDBITS(32);
+        if ((hold & 0xffff) != ((hold >> 16) ^ 0xffff))
+            return Z_DATA_ERROR;
+        copy = (unsigned)hold & 0xffff;
+        hold = 0;
+        bits = 0;
+        if ((unsigned long)(end - next) < copy)
+            goto more;
+        if (s->size - have < copy)
+            goto full;
+        while (copy--)
+            out[have++] = *next++;
+        goto done;
+    case 1:                                     /* fixed block */
+        spec_fixed(s, &lencode, &distcode);
+        lenbits = 9;
+        distbits = 5;
+        break;
+    case 2: {                                   /* dynamic block */
+        unsigned nlen, ndist, ncode, n;
+        code FAR *tables;
+
+        NEEDBITS(14);
+        nlen = BITS(5) + 257;
+        DROPBITS(5);
+        ndist = BITS(5) + 1;
+        DROPBITS(5);
+        ncode = BITS(4) + 4;
+        DROPBITS(4);
+        if (nlen > 286 || ndist > 30)
+            return Z_DATA_ERROR;
+        for (n = 0; n < ncode; n++) {
+            NEEDBITS(3);
+            s->lens[order[n]] = (unsigned short)BITS(3);
+            DROPBITS(3);
+        }
+        while (n < 19)
+            s->lens[order[n++]] = 0;
+        tables = s->codes;
+        lencode = (const code FAR *)tables;
+        lenbits = 7;
+        if (inflate_table(CODES, s->lens, 19, &tables, &lenbits, s->work, 0))
+            return Z_DATA_ERROR;
+        n = 0;
+        while (n < nlen + ndist) {
+            for (;;) {
+                here = lencode[BITS(lenbits)];
+                if ((unsigned)(here.bits) <= bits) break;
+                PULLBYTE();
+            }
+            if (here.val < 16) {
+                DROPBITS(here.bits);
+                s->lens[n++] = here.val;
+                continue;
+            }
+            if (here.val == 16) {
+                NEEDBITS(here.bits + 2);
+                DROPBITS(here.bits);
+                if (n == 0)
+                    return Z_DATA_ERROR;
+                len = s->lens[n - 1];
+                copy = 3 + BITS(2);
+                DROPBITS(2);
+            }
+            else if (here.val == 17) {
+                NEEDBITS(here.bits + 3);
+                DROPBITS(here.bits);
+                len = 0;
+                copy = 3 + BITS(3);
+                DROPBITS(3);
+            }
+            else {
+                NEEDBITS(here.bits + 7);
+                DROPBITS(here.bits);
+                len = 0;
+                copy = 11 + BITS(7);
+                DROPBITS(7);
+            }
+            if (n + copy > nlen + ndist)
+                return Z_DATA_ERROR;
+            while (copy--)
+                s->lens[n++] = (unsigned short)len;
+        }
+        if (s->lens[256] == 0)
+            return Z_DATA_ERROR;
+        tables = s->codes;
+        lencode = (const code FAR *)tables;
+        lenbits = INFLATE_LEN_ROOT;
+        if (inflate_table(LENS, s->lens, nlen, &tables, &lenbits, s->work, 0))
+            return Z_DATA_ERROR;
+        distcode = (const code FAR *)tables;
+        distbits = INFLATE_DIST_ROOT;
+        if (inflate_table(DISTS, s->lens + nlen, ndist, &tables, &distbits,
+                          s->work, 0))
+            return Z_DATA_ERROR;
+        break;
+    }
+    default:
+        return Z_DATA_ERROR;
+    }
+
+    /* decode literals and length/distance pairs, as in inflate_fast() */
+    for (;;) {
+        for (;;) {
+            here = lencode[BITS(lenbits)];
+            if ((unsigned)(here.bits) <= bits) break;
+            PULLBYTE();
+        }
+        if (here.op && (here.op & 0xf0) == 0) {
+            prev = here;
+            for (;;) {
+                here = lencode[prev.val +
+                        (BITS(prev.bits + prev.op) >> prev.bits)];
+                if ((unsigned)(prev.bits + here.bits) <= bits) break;
+                PULLBYTE();
+            }
+            DROPBITS(prev.bits);
+        }
+        DROPBITS(here.bits);
+        op = here.op;
+        if (op == 0) {                          /* literal */
+            if (have == s->size)
+                goto full;
+            out[have++] = here.val;
+            continue;
+        }
+        if (op & 32)                            /* end of block */
+            break;
+        if (op & 64)                            /* invalid code */
+            return Z_DATA_ERROR;
+        len = here.val;
+        op &= 15;
+        if (op) {
+            NEEDBITS(op);
+            len += BITS(op);
+            DROPBITS(op);
+        }
+        for (;;) {
+            here = distcode[BITS(distbits)];
+            if ((unsigned)(here.bits) <= bits) break;
+            PULLBYTE();
+        }
+        if ((here.op & 0xf0) == 0) {
+            prev = here;
+            for (;;) {
+                here = distcode[prev.val +
+                        (BITS(prev.bits + prev.op) >> prev.bits)];
+                if ((unsigned)(prev.bits + here.bits) <= bits) break;
+                PULLBYTE();
+            }
+            DROPBITS(prev.bits);
+        }
+        DROPBITS(here.bits);
+        if (here.op & 64)                       /* invalid distance code */
+            return Z_DATA_ERROR;
+        dist = here.val;
+        op = here.op & 15;
+        if (op) {
+            NEEDBITS(op);
+            dist += BITS(op);
+            DROPBITS(op);
+        }
+        if (dist > have + s->wsize)             /* too far back */
+            return Z_DATA_ERROR;
+        if (s->size - have < len)
+            goto full;
+        from = (long)have - (long)dist;
+        if (from < 0) {                         /* markers for the window */
+            markers++;
+            while (from < 0 && len) {
+                out[have++] = (unsigned short)(SPEC_MARKER + SPEC_WSIZE + from);
+                from++;
+                len--;
+            }
+        }
+        while (len--)
+            out[have++] = out[from++];
+    }
+
+  done:
+    s->pos = POS();
+    s->have = have;
+    s->markers = markers;
+    s->last = (int)last;
+    return Z_OK;
+  more:
+    return Z_BUF_ERROR;
+  full:
+    s->full = 1;
+    return Z_BUF_ERROR;
+}
+
+/*
+   Look for the first block at a bit offset from s->pos up to end (excluded)
+   and decode it.  Candidates are dynamic blocks that are not the final
+   block, as these have the longest headers to check.  s->start is set to
+   the offset of the block found.  Z_DATA_ERROR is returned if there is no
+   such block, Z_BUF_ERROR if the input or the output space (s->full) ends
+   first; s->pos is then the candidate to try again.
+ */
+int ZLIB_INTERNAL inflate_spec_find(spec_state FAR *s, unsigned long end) {
+    unsigned long pos;
+    unsigned head;
+    int ret;
+
+    for (pos = s->pos; pos < end && pos + 3 <= s->len * 8; pos++) {
+        /* BFINAL == 0, BTYPE == 10 */
+        head = s->in[pos >> 3];
+        if ((pos >> 3) + 1 < s->len)
+            head |= (unsigned)s->in[(pos >> 3) + 1] << 8;
+        if (((head >> (pos & 7)) & 7) != 4)
+            continue;
+        s->pos = pos;
+        ret = spec_block(s);
+        if (ret == Z_OK) {
+            s->start = pos;
+            return Z_OK;
+        }
+        if (ret == Z_BUF_ERROR)
+            return ret;
+    }
+    s->pos = pos;
+    return Z_DATA_ERROR;
+}
+
+/*
+   Decode blocks from s->pos until the final block or a block that starts at
+   or after stop.  On Z_BUF_ERROR, s->pos is the block to decode again with
+   more input or, if s->full is set, with more output space.
+ */
+int ZLIB_INTERNAL inflate_spec_blocks(spec_state FAR *s, unsigned long stop) {
+    int ret;
+
+    while (!s->last && s->pos < stop) {
+        ret = spec_block(s);
+        if (ret != Z_OK)
+            return ret;
+    }
+    return Z_OK;
+}
@@ -0,0 +1,39 @@
+/* infspec.h -- header to use infspec.c
+ * Copyright (C) 2026 Gildas Lormeau
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/* Size of the window that a speculative decoding may refer to. */
+#define SPEC_WSIZE 32768U
+
+/* Decoded symbols below SPEC_MARKER are literal bytes.  A symbol sym at or
+   above it is a marker for the unknown byte at index sym - SPEC_MARKER of the
+   SPEC_WSIZE bytes that precede the decoded data. */
+#define SPEC_MARKER 256
+
+/* State of a speculative decoding.  The caller sets in, len, pos, out, size
+   and wsize and clears have, markers, last and full. */
+typedef struct {
+    const unsigned char FAR *in;    /* raw deflate data */
+    unsigned long len;              /* bytes available at in */
+    unsigned long start;            /* bit offset of the first block */
+    unsigned long pos;              /* bit offset of the next block header */
+    unsigned short FAR *out;        /* decoded symbols */
+    unsigned long have;             /* number of decoded symbols */
+    unsigned long size;             /* number of symbols that fit in out */
+    unsigned long markers;          /* matches that reached before out */
+    unsigned wsize;                 /* how far before out matches may reach */
+    int last;                       /* true if the final block was decoded */
+    int full;                       /* true if stopped for lack of space */
+    unsigned short lens[320];       /* temporary storage for code lengths */
+    unsigned short work[288];       /* work area for code table building */
+    code codes[ENOUGH_LENS+ENOUGH_DISTS];   /* space for code tables */
+} spec_state;
+
+int ZLIB_INTERNAL inflate_spec_find(spec_state FAR *s, unsigned long end);
+int ZLIB_INTERNAL inflate_spec_blocks(spec_state FAR *s, unsigned long stop);
@@ -0,0 +1,47 @@
+/* infstats.h -- optional inflate instrumentation
+ * Copyright (C) 2026 Gildas Lormeau
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/* Counters kept for each stream by inflate() when compiled with
+   INFLATE_STATS, and returned by inflateGetStats().  They accumulate from
+   inflateInit() on, across resets.  The histograms have log2 buckets: bucket
+   n counts the values v with 2^n <= v < 2^(n+1).  All the fields are
+   unsigned long so that the structure can be read as an array. */
+typedef struct inf_stats_s {
+    unsigned long stored;       /* stored blocks */
+    unsigned long fixed;        /* fixed code blocks */
+    unsigned long dynamic;      /* dynamic code blocks */
+    unsigned long tables;       /* code tables built by inflate_table() */
+    unsigned long cached;       /* dynamic headers whose tables were cached */
+    unsigned long fast;         /* codes decoded by inflate_fast() */
+    unsigned long slow;         /* codes decoded by inflate() */
+    unsigned long window_copies;    /* updatewindow() calls */
+    unsigned long window_bytes;     /* bytes copied or moved in the window */
+    unsigned long lengths[17];  /* match lengths */
+    unsigned long dists[17];    /* match distances */
+} inf_stats;
+
+#ifdef INFLATE_STATS
+#  define INFSTAT(x) (x)
+#  define INFSTAT_MATCH(stats, len, dist) \
+    do { \
+        unsigned v_, n_; \
+        for (v_ = (len), n_ = 0; v_ >>= 1; n_++) ; \
+        (stats).lengths[n_]++; \
+        for (v_ = (dist), n_ = 0; v_ >>= 1; n_++) ; \
+        (stats).dists[n_]++; \
+    } while (0)
+#else
+#  define INFSTAT(x)
+#  define INFSTAT_MATCH(stats, len, dist)
+#endif
+
+/* Copy the counters of strm to stats.  Return Z_STREAM_ERROR if the state
+   is inconsistent or if the library was compiled without INFLATE_STATS. */
+int ZEXPORT inflateGetStats(z_streamp strm, inf_stats FAR *stats);
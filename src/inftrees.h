@@ -37,21 +37,51 @@ typedef struct {
     01000000 - invalid code
  */
 
+/* Root table bits of the dynamic length/literal and distance tables built by
+   inflate().  A code no longer than the root resolves in a single lookup,
+   longer ones in a second one in a sub-table.  zlib uses 9 and 6; larger
+   roots resolve more codes at once at the cost of larger tables to fill for
+   each dynamic block and to keep in cache.  Lengths may use 9 to 11 bits and
+   distances 6 to 8. */
+#ifndef INFLATE_LEN_ROOT
+#  define INFLATE_LEN_ROOT 9
+#endif
+#ifndef INFLATE_DIST_ROOT
+#  define INFLATE_DIST_ROOT 6
+#endif
+
 /* Maximum size of the dynamic table.  The maximum number of code structures is
-   1446, which is the sum of 852 for literal/length codes and 594 for distance
-   codes.  These values were found by exhaustive searches using the program
+   the sum of those for literal/length codes and for distance codes.  These
+   values were found by exhaustive searches using the program
    examples/enough.c found in the zlib distribution.  The arguments to that
    program are the number of symbols, the initial root table size, and the
    maximum bit length of a code.  "enough 286 9 15" for literal/length codes
    returns 852, "enough 30 6 15" for deflate distance codes returns 592, and
-   "enough 32 6 15" for deflate64 distance codes returns 594.  The initial
-   root table size (9 or 6) is found in the fifth argument of the
-   inflate_table() calls in inflate.c and infback.c.  If the root table size is
-   changed, then these maximum sizes would be need to be recalculated and
-   updated. */
-#define ENOUGH_LENS 852
-#define ENOUGH_DISTS 592
-#define ENOUGH_DISTS_9 594
+   "enough 32 6 15" for deflate64 distance codes returns 594.  With a root of
+   10 or 11, "enough 286 10 15" returns 1332 and "enough 286 11 15" 2340; with
+   a root of 7 or 8, enough returns 400 for 30 distance codes and 402 for 32.
+   The initial root table sizes are INFLATE_LEN_ROOT and INFLATE_DIST_ROOT,
+   used by the inflate_table() calls in inflate.c and infspec.c.  If another
+   root table size is added, then these maximum sizes would need to be
+   calculated for it. */
+#if INFLATE_LEN_ROOT == 9
+#  define ENOUGH_LENS 852
+#elif INFLATE_LEN_ROOT == 10
+#  define ENOUGH_LENS 1332
+#elif INFLATE_LEN_ROOT == 11
+#  define ENOUGH_LENS 2340
+#else
+#  error "INFLATE_LEN_ROOT must be 9, 10 or 11"
+#endif
+#if INFLATE_DIST_ROOT == 6
+#  define ENOUGH_DISTS 592
+#  define ENOUGH_DISTS_9 594
+#elif INFLATE_DIST_ROOT == 7 || INFLATE_DIST_ROOT == 8
+#  define ENOUGH_DISTS 400
+#  define ENOUGH_DISTS_9 402
+#else
+#  error "INFLATE_DIST_ROOT must be 6, 7 or 8"
+#endif
 #define ENOUGH (ENOUGH_LENS+ENOUGH_DISTS_9)
 
 /* Type of code to build for inflate_table() */
@@ -829,17 +829,17 @@ void ZLIB_INTERNAL _tr_align(deflate_state *s) {
 }
 
 /* ===========================================================================
- * Send the block data compressed using the given Huffman trees
+ * Send the block data compressed using the given Huffman trees: the symbols
+ * from sx up to end in the symbol buffers.
  */
 local void compress_block(deflate_state *s, const ct_data *ltree,
-                          const ct_data *dtree) {
+                          const ct_data *dtree, unsigned sx, unsigned end) {
     unsigned dist;      /* distance of matched string */
     int lc;             /* match length or unmatched char (if dist == 0) */
-    unsigned sx = 0;    /* running index in symbol buffers */
     unsigned code;      /* the code to send */
     int extra;          /* number of extra bits to send */
 
-    if (s->sym_next != 0) do {
+    if (sx < end) do {
 #ifdef LIT_MEM
         dist = s->d_buf[sx];
         lc = s->l_buf[sx++];
@@ -879,7 +879,7 @@ local void compress_block(deflate_state *s, const ct_data *ltree,
         Assert(s->pending < s->lit_bufsize + sx, "pendingBuf overflow");
 #endif
 
-    } while (sx < s->sym_next);
+    } while (sx < end);
 
     send_code(s, END_BLOCK, ltree);
 }
@@ -925,21 +925,199 @@ local int detect_data_type(deflate_state *s) {
 }
 
 /* ===========================================================================
- * Determine the best encoding for the current block: dynamic trees, static
- * trees or store, and write out the encoded block.
+ * Block splitting. A block ends when the symbol buffer is full, whatever the
+ * statistics of the data, so that the same Huffman trees may have to code
+ * text and binary data, or the contents of several files of an archive.
+ * Before coding the buffered symbols, _tr_flush_block() looks at them in
+ * segments of SPLIT_SEGMENT symbols, and ends a block before a segment when
+ * the two coded apart, each with its own trees, are estimated to be smaller
+ * than the two coded together. The estimates are the entropies of the
+ * literal/length codes plus a guess of the size of the trees, so that no
+ * tree is built for them.
  */
-void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
-                                   ulg stored_len, int last) {
+#define SPLIT_SEGMENT 1024  /* symbols per segment */
+#define SPLIT_MAX 8         /* most blocks added by a flush */
+#define SPLIT_TREES 96      /* bits of a tree representation ... */
+#define SPLIT_CODE 8        /* ... plus this per code used */
+
+/* pending_buf overlays the symbol buffers: a block that is ended early must
+ * not take more than SYM_ROOM bytes per symbol, the room that its symbols
+ * leave, for the next one to start as far from its symbols as the first.
+ */
+#ifdef LIT_MEM
+#  define SYM_UNIT 1        /* symbol buffer indices per symbol */
+#  define SYM_ROOM 2
+#else
+#  define SYM_UNIT 3
+#  define SYM_ROOM 3
+#endif
+
+/* ===========================================================================
+ * Return log2(x) in 1/256 bits, approximately, for 0 < x < 2^24.
+ */
+local ulg split_log2(unsigned x) {
+    int n = 0;  /* floor(log2(x)) */
+
+    if (x >> 16) n = 16;
+    if (x >> (n + 8)) n += 8;
+    if (x >> (n + 4)) n += 4;
+    if (x >> (n + 2)) n += 2;
+    if (x >> (n + 1)) n += 1;
+    return ((ulg)n << 8) + (((x << 8) >> n) & 0xff);
+}
+
+/* ===========================================================================
+ * Estimate in 1/256 bits the size of a block of total literal/length codes,
+ * of which used are different and flog is the sum of f * log2(f) over their
+ * frequencies f: their entropy plus the size of the trees. Distance codes
+ * and extra bits are left out.
+ */
+local ulg split_bits(ulg total, ulg flog, int used) {
+    return total * split_log2((unsigned)total) - flog +
+           (((ulg)SPLIT_TREES + (ulg)used * SPLIT_CODE) << 8);
+}
+
+/* ===========================================================================
+ * Count in freq[] the literal/length codes of the symbols from sx up to end
+ * in the symbol buffers.
+ */
+local void split_count(deflate_state *s, unsigned sx, unsigned end,
+                       unsigned *freq) {
+    int lc;             /* match length or unmatched char */
+    int n;
+
+    for (n = 0; n < L_CODES; n++) freq[n] = 0;
+    while (sx < end) {
+#ifdef LIT_MEM
+        lc = s->l_buf[sx];
+        freq[s->d_buf[sx++] == 0 ? lc : _length_code[lc] + LITERALS + 1]++;
+#else
+        lc = s->sym_buf[sx + 2];
+        freq[(s->sym_buf[sx] | s->sym_buf[sx + 1]) == 0 ? lc :
+             _length_code[lc] + LITERALS + 1]++;
+        sx += 3;
+#endif
+    }
+}
+
+/* ===========================================================================
+ * Choose where to end blocks early in the symbol buffers: return the number
+ * of blocks to add, and their starts in start[].
+ */
+local int split_block(deflate_state *s, unsigned *start) {
+    unsigned freq[2][L_CODES];
+    unsigned *block = freq[0], *seg = freq[1], *swap;
+    unsigned size = SPLIT_SEGMENT * SYM_UNIT;
+    unsigned sx, end;   /* segment bounds in the symbol buffers */
+    ulg block_total, block_flog, seg_total, seg_flog, both_flog;
+    int block_used, seg_used, both_used;
+    unsigned a, f;      /* frequency of a code in the block, the segment */
+    int count = 0;      /* blocks added */
+    int n;
+
+    if (s->sym_next < 2 * size)
+        return 0;
+    split_count(s, 0, size, block);
+    block_total = block_flog = 0;
+    block_used = 0;
+    for (n = 0; n < L_CODES; n++)
+        if ((f = block[n]) != 0) {
+            block_total += f;
+            block_flog += f * split_log2(f);
+            block_used++;
+        }
+    for (sx = size; sx < s->sym_next; sx = end) {
+        /* the last segment takes the symbols left after it */
+        end = s->sym_next - sx < 2 * size ? s->sym_next : sx + size;
+        split_count(s, sx, end, seg);
+        seg_total = seg_flog = 0;
+        both_flog = block_flog;
+        seg_used = 0;
+        both_used = block_used;
+        for (n = 0; n < L_CODES; n++)
+            if ((f = seg[n]) != 0) {
+                a = block[n];
+                seg_total += f;
+                seg_flog += f * split_log2(f);
+                seg_used++;
+                both_flog += (a + f) * split_log2(a + f);
+                if (a != 0)
+                    both_flog -= a * split_log2(a);
+                else
+                    both_used++;
+            }
+
+        if (count < SPLIT_MAX &&
+            split_bits(block_total + seg_total, both_flog, both_used) >
+                split_bits(block_total, block_flog, block_used) +
+                split_bits(seg_total, seg_flog, seg_used)) {
+            start[count++] = sx;
+            swap = block, block = seg, seg = swap;
+            block_total = seg_total;
+            block_flog = seg_flog;
+            block_used = seg_used;
+        } else {
+            for (n = 0; n < L_CODES; n++) block[n] += seg[n];
+            block_total += seg_total;
+            block_flog = both_flog;
+            block_used = both_used;
+        }
+    }
+    return count;
+}
+
+/* ===========================================================================
+ * Set the frequencies of the trees to those of the symbols from sx up to end
+ * in the symbol buffers, and return the number of input bytes of these.
+ */
+local ulg tally_range(deflate_state *s, unsigned sx, unsigned end) {
+    unsigned dist;      /* distance of matched string */
+    int lc;             /* match length or unmatched char (if dist == 0) */
+    ulg bytes = 0;      /* input bytes of the symbols */
+    int n;
+
+    for (n = 0; n < L_CODES;  n++) s->dyn_ltree[n].Freq = 0;
+    for (n = 0; n < D_CODES;  n++) s->dyn_dtree[n].Freq = 0;
+    for (n = 0; n < BL_CODES; n++) s->bl_tree[n].Freq = 0;
+
+    s->dyn_ltree[END_BLOCK].Freq = 1;
+    s->opt_len = s->static_len = 0L;
+
+    while (sx < end) {
+#ifdef LIT_MEM
+        dist = s->d_buf[sx];
+        lc = s->l_buf[sx++];
+#else
+        dist = s->sym_buf[sx++] & 0xff;
+        dist += (unsigned)(s->sym_buf[sx++] & 0xff) << 8;
+        lc = s->sym_buf[sx++];
+#endif
+        if (dist == 0) {
+            s->dyn_ltree[lc].Freq++;
+            bytes++;
+        } else {
+            s->dyn_ltree[_length_code[lc] + LITERALS + 1].Freq++;
+            s->dyn_dtree[d_code(dist - 1)].Freq++;
+            bytes += (ulg)lc + MIN_MATCH;
+        }
+    }
+    return bytes;
+}
+
+/* ===========================================================================
+ * Determine the best encoding for the symbols from sx up to end, of which
+ * the trees have the frequencies: dynamic trees, static trees or store, and
+ * write out the encoded block. If room is not zero, and the block would take
+ * more than room bytes, write nothing. Return true if the block was written.
+ */
+local int send_block(deflate_state *s, charf *buf, ulg stored_len, int last,
+                     unsigned sx, unsigned end, ulg room) {
     ulg opt_lenb, static_lenb; /* opt_len and static_len in bytes */
     int max_blindex = 0;  /* index of last bit length code of non zero freq */
 
     /* Build the Huffman trees unless a stored block is forced */
     if (s->level > 0) {
 
-        /* Check if the file is binary or text */
-        if (s->strm->data_type == Z_UNKNOWN)
-            s->strm->data_type = detect_data_type(s);
-
         /* Construct the literal and distance trees */
         build_tree(s, (tree_desc *)(&(s->l_desc)));
         Tracev((stderr, "\nlit data: dyn %ld, stat %ld", s->opt_len,
@@ -963,7 +1141,7 @@ void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
 
         Tracev((stderr, "\nopt %lu(%lu) stat %lu(%lu) stored %lu lit %u ",
                 opt_lenb, s->opt_len, static_lenb, s->static_len, stored_len,
-                s->sym_next / 3));
+                (end - sx) / SYM_UNIT));
 
 #ifndef FORCE_STATIC
         if (static_lenb <= opt_lenb || s->strategy == Z_FIXED)
@@ -975,6 +1153,10 @@ void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
         opt_lenb = static_lenb = stored_len + 5; /* force a stored block */
     }
 
+    /* A stored block may take a byte more than opt_lenb, to align */
+    if (room != 0 && opt_lenb + 1 > room)
+        return 0;
+
 #ifdef FORCE_STORED
     if (buf != (char*)0) { /* force stored block */
 #else
@@ -992,7 +1174,7 @@ void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
     } else if (static_lenb == opt_lenb) {
         send_bits(s, (STATIC_TREES<<1) + last, 3);
         compress_block(s, (const ct_data *)static_ltree,
-                       (const ct_data *)static_dtree);
+                       (const ct_data *)static_dtree, sx, end);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->static_len;
 #endif
@@ -1001,7 +1183,7 @@ void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
         send_all_trees(s, s->l_desc.max_code + 1, s->d_desc.max_code + 1,
                        max_blindex + 1);
         compress_block(s, (const ct_data *)s->dyn_ltree,
-                       (const ct_data *)s->dyn_dtree);
+                       (const ct_data *)s->dyn_dtree, sx, end);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->opt_len;
 #endif
@@ -1010,6 +1192,45 @@ void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
     /* The above check is made mod 2^32, for files larger than 512 MB
      * and uLong implemented on 32 bits.
      */
+    return 1;
+}
+
+/* ===========================================================================
+ * Write out the current block, as several blocks where new trees pay for
+ * themselves.
+ */
+void ZLIB_INTERNAL _tr_flush_block(deflate_state *s, charf *buf,
+                                   ulg stored_len, int last) {
+    unsigned start[SPLIT_MAX];  /* starts of the blocks added */
+    int count = 0;      /* number of blocks added */
+    unsigned sx = 0;    /* start of the next block to write */
+    ulg len;            /* input bytes of a block added */
+    int n;
+
+    if (s->level > 0) {
+
+        /* Check if the file is binary or text */
+        if (s->strm->data_type == Z_UNKNOWN)
+            s->strm->data_type = detect_data_type(s);
+
+        /* Find where to end blocks early */
+        if (s->strategy != Z_FIXED)
+            count = split_block(s, start);
+    }
+
+    for (n = 0; n < count; n++) {
+        /* a block that does not fit is merged with the next one */
+        len = tally_range(s, sx, start[n]);
+        if (send_block(s, buf, len, 0, sx, start[n],
+                       (ulg)(start[n] - sx) / SYM_UNIT * SYM_ROOM)) {
+            sx = start[n];
+            stored_len -= len;
+            if (buf != (char*)0) buf += len;
+        }
+    }
+    if (count != 0)
+        tally_range(s, sx, s->sym_next);
+    send_block(s, buf, stored_len, last, sx, s->sym_next, 0);
     init_block(s);
 
     if (last) {
@@ -1,12 +1,38 @@
 #include <stdlib.h>
 #include "zlib.h"
+#include "allocator.h"
+
+// zfree is not given the size: keep it in front of the block, in a header
+// as large as malloc's alignment.
+#define ZALLOC_HEADER 8
+
+struct wasm_alloc_counters wasm_alloc;
+
+void wasm_alloc_account(long delta) {
+  wasm_alloc.live += delta;
+  if (wasm_alloc.live > wasm_alloc.peak)
+    wasm_alloc.peak = wasm_alloc.live;
+}
 
 voidpf my_zalloc(voidpf opaque, unsigned items, unsigned size) {
   (void)opaque;
-  return malloc(items * size);
+  size_t n = (size_t)items * size;
+  unsigned char *p = (unsigned char *)malloc(n + ZALLOC_HEADER);
+  if (!p)
+    return Z_NULL;
+  *(size_t *)p = n;
+  wasm_alloc.zlib += n;
+  wasm_alloc_account((long)n);
+  return p + ZALLOC_HEADER;
 }
 
 void my_zfree(voidpf opaque, voidpf ptr) {
   (void)opaque;
-  free(ptr);
+  if (!ptr)
+    return;
+  unsigned char *p = (unsigned char *)ptr - ZALLOC_HEADER;
+  size_t n = *(size_t *)p;
+  wasm_alloc.zlib -= n;
+  wasm_alloc_account(-(long)n);
+  free(p);
 }
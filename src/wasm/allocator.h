@@ -1,4 +1,24 @@
+#ifndef WASM_ALLOCATOR_H
+#define WASM_ALLOCATOR_H
+
+#include <stddef.h>
 #include <zconf.h>
 
+// Heap accounting behind wasm_stats: bytes handed to zlib by my_zalloc plus
+// the contexts and buffers of the wasm layer (see wasm_alloc_account), and
+// the memory budget that stream initialization reserves from.
+struct wasm_alloc_counters {
+  size_t live;
+  size_t peak;
+  size_t zlib;
+  size_t reserved;
+  size_t budget; /* 0: unlimited */
+};
+
+extern struct wasm_alloc_counters wasm_alloc;
+
 voidpf my_zalloc(voidpf opaque, unsigned items, unsigned size);
 void my_zfree(voidpf opaque, voidpf ptr);
+void wasm_alloc_account(long delta);
+
+#endif // WASM_ALLOCATOR_H
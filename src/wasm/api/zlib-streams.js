@@ -1,10 +1,11 @@
 /* eslint-disable no-unused-vars */
-/* global Buffer, process, TransformStream */
+/* global Buffer, process, TransformStream, performance, setTimeout, clearTimeout, WeakRef */
 
 let wasm, malloc, free, memory;
 
 export function setWasmExports(wasmAPI) {
 	wasm = wasmAPI;
+	arena = null;
 	({ malloc, free, memory } = wasm);
 	if (typeof malloc !== "function" || typeof free !== "function" || !memory) {
 		wasm = malloc = free = memory = null;
@@ -16,62 +17,115 @@ function _make(isCompress, type, options = {}) {
 	const level = (typeof options.level === "number") ? options.level : -1;
 	const outBufferSize = (typeof options.outBuffer === "number") ? options.outBuffer : 64 * 1024;
 	const inBufferSize = (typeof options.inBufferSize === "number") ? options.inBufferSize : 64 * 1024;
+	const onMemberEnd = (typeof options.onMemberEnd === "function") ? options.onMemberEnd : null;
+	const onStats = (typeof options.onStats === "function") ? options.onStats : null;
+	const memoryPolicy = options.memoryPolicy || "wait";
+	const sharedBuffers = Boolean(options.sharedBuffers);
+	// idle milliseconds before the stream hibernates, see hibernate() below
+	const idleDelay = (typeof options.hibernate === "number" && options.hibernate >= 0) ? options.hibernate :
+		options.hibernate === true ? HIBERNATE_DELAY : -1;
+	// decompression into a ring of this size, a power of two of at least two
+	// windows, that the decoder reads its matches from (see wasm_inflate_ring)
+	const outputRing = (!isCompress && typeof options.outputRing === "number") ? options.outputRing : 0;
+	if (outputRing && ((outputRing & (outputRing - 1)) || outputRing < (type === "deflate64-raw" ? 128 : 64) * 1024 || outputRing > 8 * 1024 * 1024)) {
+		throw new Error("unsupported outputRing: " + outputRing);
+	}
+	const expectedSize = (typeof options.expectedSize === "number" && options.expectedSize > 0) ? Math.min(options.expectedSize, 0x7fffffff) : 0;
+	const skipIncompressible = Boolean(options.skipIncompressible);
+	// compression cost to aim at, in microseconds per MiB of input
+	const target = (typeof options.targetMBps === "number" && options.targetMBps > 0) ? Math.max(1, Math.round(1e6 / options.targetMBps)) :
+		(typeof options.maxMsPerMB === "number" && options.maxMsPerMB > 0) ? Math.max(1, Math.round(options.maxMsPerMB * 1000)) : 0;
+	const timed = isCompress && target > 0;
+	const strategy = STRATEGIES.indexOf(options.strategy === undefined ? "default" : options.strategy);
+	if (strategy === -1) {
+		throw new Error("unsupported strategy: " + options.strategy);
+	}
 
-	return new TransformStream({
-		start() {
+	const transformer = {
+		start(controller) {
 			let result;
-			this.out = malloc(outBufferSize);
-			this.in = malloc(inBufferSize);
-			this.inBufferSize = inBufferSize;
-			this._scratch = new Uint8Array(outBufferSize);
+			// the registry holds the transformer: it must not keep the stream alive
+			this._controller = typeof WeakRef === "function" ? new WeakRef(controller) : { deref: () => controller };
+			this._idleTimer = null;
+			this._asleep = false;
+			this._shared = sharedBuffers;
+			if (sharedBuffers) {
+				this.in = this.out = this.inBufferSize = 0;
+			} else {
+				this.out = outputRing ? 0 : malloc(outBufferSize);
+				this.in = malloc(inBufferSize);
+				this.inBufferSize = inBufferSize;
+			}
 			if (isCompress) {
 				this._process = wasm.deflate_process;
 				this._last_consumed = wasm.deflate_last_consumed;
 				this._end = wasm.deflate_end;
+				this._hibernate = wasm.deflate_hibernate;
 				this.streamHandle = wasm.deflate_new();
-				if (type === "gzip") {
-					result = wasm.deflate_init_gzip(this.streamHandle, level);
-				} else if (type === "deflate-raw") {
-					result = wasm.deflate_init_raw(this.streamHandle, level);
-				} else {
-					result = wasm.deflate_init(this.streamHandle, level);
+				if (skipIncompressible) {
+					wasm.deflate_set_probe(this.streamHandle, 1);
+				}
+				if (timed) {
+					wasm.deflate_set_target(this.streamHandle, target);
 				}
+				wasm.deflate_set_strategy(this.streamHandle, strategy - 1);
+				const format = (windowBits) => type === "gzip" ? windowBits + 16 : type === "deflate-raw" ? -windowBits : windowBits;
+				this._init = (windowBits, memLevel) => windowBits === undefined ?
+					wasm.deflate_init_sized(this.streamHandle, level, format(15), expectedSize) :
+					wasm.deflate_init_params(this.streamHandle, level, format(windowBits), memLevel);
 			} else {
 				if (type === "deflate64-raw") {
 					this._process = wasm.inflate9_process;
 					this._last_consumed = wasm.inflate9_last_consumed;
 					this._end = wasm.inflate9_end;
+					this._hibernate = wasm.inflate9_hibernate;
 					this.streamHandle = wasm.inflate9_new();
-					result = wasm.inflate9_init_raw(this.streamHandle);
+					this._stats = wasm.inflate9_stats;
+					this._init = () => wasm.inflate9_init_raw(this.streamHandle);
 				} else {
 					this._process = wasm.inflate_process;
 					this._last_consumed = wasm.inflate_last_consumed;
 					this._end = wasm.inflate_end;
+					this._hibernate = wasm.inflate_hibernate;
 					this.streamHandle = wasm.inflate_new();
+					this._stats = wasm.inflate_stats;
 					if (type === "deflate-raw") {
-						result = wasm.inflate_init_raw(this.streamHandle);
+						this._init = () => wasm.inflate_init_raw(this.streamHandle);
 					} else if (type === "gzip") {
-						result = wasm.inflate_init_gzip(this.streamHandle);
+						this._init = () => wasm.inflate_init_gzip(this.streamHandle);
+						this._members = wasm.inflate_members;
 					} else {
-						result = wasm.inflate_init(this.streamHandle);
+						this._init = () => wasm.inflate_init(this.streamHandle);
 					}
 				}
+				if (outputRing) {
+					_ringMode(this, type === "deflate64-raw" ? "inflate9" : "inflate", outputRing);
+				}
 			}
-			if (result !== 0) {
-				throw new Error("init failed:" + result);
+			this.totalIn = 0;
+			this.totalOut = 0;
+			this.members = 0;
+			result = this._init();
+			if (result === Z_MEM_ERROR && memoryPolicy !== "error") {
+				return _admit(this, isCompress && memoryPolicy === "downgrade");
 			}
+			_initialized(this, result);
 		},
 		transform(chunk, controller) {
+			clearTimeout(this._idleTimer);
+			// the process calls wake the stream
+			this._asleep = false;
 			try {
 				const buffer = chunk;
-				const heap = new Uint8Array(memory.buffer);
 				const process = this._process;
 				const last_consumed = this._last_consumed;
+				if (sharedBuffers) {
+					_borrow(this, outBufferSize);
+				}
 				const out = this.out;
-				const scratch = this._scratch;
 				let offset = 0;
 				while (offset < buffer.length) {
-					const toRead = Math.min(buffer.length - offset, 32 * 1024);
+					const toRead = Math.min(buffer.length - offset, IN_CHUNK_SIZE);
 					if (!this.in || this.inBufferSize < toRead) {
 						if (this.in && free) {
 							free(this.in);
@@ -79,12 +133,16 @@ function _make(isCompress, type, options = {}) {
 						this.in = malloc(toRead);
 						this.inBufferSize = toRead;
 					}
-					heap.set(buffer.subarray(offset, offset + toRead), this.in);
+					new Uint8Array(memory.buffer).set(buffer.subarray(offset, offset + toRead), this.in);
+					const start = timed ? performance.now() : 0;
 					const result = process(this.streamHandle, this.in, toRead, out, outBufferSize, 0);
+					if (timed) {
+						wasm.deflate_account_time(this.streamHandle, (performance.now() - start) * 1000);
+					}
 					const prod = result & 0x00ffffff;
 					if (prod) {
-						scratch.set(heap.subarray(out, out + prod), 0);
-						controller.enqueue(scratch.slice(0, prod));
+						const at = this._ringOut ? this._ringOut(this.streamHandle) : out;
+						controller.enqueue(new Uint8Array(memory.buffer, at, prod).slice());
 					}
 					if (!isCompress) {
 						const code = (result >> 24) & 0xff;
@@ -94,30 +152,38 @@ function _make(isCompress, type, options = {}) {
 						}
 					}
 					const consumed = last_consumed(this.streamHandle);
-					if (consumed === 0) {
+					this.totalIn += consumed;
+					this.totalOut += prod;
+					if (this._members) {
+						_checkMemberEnd(this, onMemberEnd);
+					}
+					if (consumed === 0 && prod === 0) {
 						break;
 					}
 					offset += consumed;
 				}
-			} catch (error) {
-				if (this._end && this.streamHandle) {
-					this._end(this.streamHandle);
-				}
-				if (this.in && free) {
-					free(this.in);
-				}
-				if (this.out && free) {
-					free(this.out);
+				if (idleDelay >= 0) {
+					this._idleTimer = setTimeout(() => this.hibernate(), idleDelay);
+					if (this._idleTimer.unref) {
+						this._idleTimer.unref();
+					}
 				}
+			} catch (error) {
+				_release(this);
 				controller.error(error);
+			} finally {
+				if (sharedBuffers) {
+					_giveBack(this);
+				}
 			}
 		},
 		flush(controller) {
 			try {
-				const heap = new Uint8Array(memory.buffer);
 				const process = this._process;
+				if (sharedBuffers) {
+					_borrow(this, outBufferSize);
+				}
 				const out = this.out;
-				const scratch = this._scratch;
 				while (true) {
 					const result = process(this.streamHandle, 0, 0, out, outBufferSize, 4);
 					const produced = result & 0x00ffffff;
@@ -129,33 +195,303 @@ function _make(isCompress, type, options = {}) {
 						}
 					}
 					if (produced) {
-						scratch.set(heap.subarray(out, out + produced), 0);
-						controller.enqueue(scratch.slice(0, produced));
+						const at = this._ringOut ? this._ringOut(this.streamHandle) : out;
+						controller.enqueue(new Uint8Array(memory.buffer, at, produced).slice());
+					}
+					this.totalOut += produced;
+					if (this._members) {
+						_checkMemberEnd(this, onMemberEnd);
 					}
 					if (code === 1 || produced === 0) {
 						break;
 					}
 				}
+				if (onStats && this._stats) {
+					const stats = _readStats(this._stats, this.streamHandle);
+					if (stats) {
+						onStats(stats);
+					}
+				} else if (onStats && isCompress) {
+					onStats({
+						storedBytes: wasm.deflate_stored_bytes(this.streamHandle),
+						strategy: STRATEGIES[wasm.deflate_strategy(this.streamHandle) + 1]
+					});
+				}
 			} catch (error) {
 				controller.error(error);
 			} finally {
-				if (this._end && this.streamHandle) {
-					const result = this._end(this.streamHandle);
-					if (result !== 0) {
-						controller.error(new Error("end error:" + result));
-					}
+				if (sharedBuffers) {
+					_giveBack(this);
+				}
+				const result = _release(this);
+				if (result !== 0) {
+					controller.error(new Error("end error:" + result));
 				}
-				if (this.in && free) {
-					free(this.in);
+			}
+		},
+		// writable aborted or readable canceled
+		cancel() {
+			_release(this);
+		},
+		// Frees the window until the next chunk, see wasm_inflate_hibernate
+		// and deflate_hibernate. Deflate can only hibernate at a flush point:
+		// the output of a sync flush is enqueued first.
+		hibernate() {
+			clearTimeout(this._idleTimer);
+			this._idleTimer = null;
+			const controller = this._controller.deref();
+			if (!this.streamHandle || this._asleep || !controller) {
+				return;
+			}
+			try {
+				if (isCompress) {
+					if (sharedBuffers) {
+						_borrow(this, outBufferSize);
+					}
+					let produced;
+					do {
+						produced = this._process(this.streamHandle, 0, 0, this.out, outBufferSize, 2) & 0x00ffffff;
+						if (produced) {
+							controller.enqueue(new Uint8Array(memory.buffer, this.out, produced).slice());
+						}
+						this.totalOut += produced;
+					} while (produced === outBufferSize);
 				}
-				if (this.out && free) {
-					free(this.out);
+				this._hibernate(this.streamHandle);
+				this._asleep = true;
+			} catch (error) {
+				_release(this);
+				controller.error(error);
+			} finally {
+				if (sharedBuffers && isCompress) {
+					_giveBack(this);
 				}
 			}
 		}
+	};
+	const stream = new TransformStream(transformer);
+	// hibernates now rather than after the idle delay
+	stream.hibernate = () => transformer.hibernate();
+	if (registry) {
+		registry.register(stream, transformer, transformer);
+	}
+	return stream;
+}
+
+// Switches an inflate transformer to output ring mode: the ring is set up once
+// the stream is initialized, and init retried by the admission queue does not
+// initialize the stream again. The process calls ignore the out buffer.
+function _ringMode(stream, prefix, size) {
+	const init = stream._init;
+	const ring = wasm[prefix + "_ring"];
+	const ringProcess = wasm[prefix + "_ring_process"];
+	let result;
+	stream._init = () => {
+		if (result !== 0) {
+			result = init();
+		}
+		return result === 0 && !ring(stream.streamHandle, size) ? Z_MEM_ERROR : result;
+	};
+	stream._process = (streamHandle, inPtr, inLength, outPtr, outLength, flush) => ringProcess(streamHandle, inPtr, inLength, flush);
+	stream._ringOut = wasm[prefix + "_ring_out"];
+}
+
+// Frees the resources of streams that are garbage collected without being
+// closed, aborted or canceled. The transformer holds no reference to its
+// stream, so it can be the held value.
+const registry = typeof FinalizationRegistry === "function" ? new FinalizationRegistry(_release) : null;
+
+// Ends the zlib stream and frees the buffers once, returns the *_end result.
+function _release(stream) {
+	let result = 0;
+	clearTimeout(stream._idleTimer);
+	const index = admissionQueue.findIndex(entry => entry.stream === stream);
+	if (index !== -1) {
+		admissionQueue.splice(index, 1);
+	}
+	if (stream._end && stream.streamHandle) {
+		result = stream._end(stream.streamHandle);
+	}
+	if (stream.in && free && !stream._shared) {
+		free(stream.in);
+	}
+	if (stream.out && free && !stream._shared) {
+		free(stream.out);
+	}
+	stream.streamHandle = stream.in = stream.out = 0;
+	if (registry) {
+		registry.unregister(stream);
+	}
+	_admitPending();
+	return result;
+}
+
+const IN_CHUNK_SIZE = 32 * 1024;
+// idle milliseconds before a stream created with { hibernate: true } frees
+// its window
+const HIBERNATE_DELAY = 1000;
+// deflate strategies by zlib value + 1, "auto" samples the first input (see
+// auto_strategy in deflate_stream_wasm.c), "quick" is the fastest and
+// ignores the level, "medium" runs levels 3 to 5 faster (see deflate_quick.h)
+const STRATEGIES = ["auto", "default", "filtered", "huffman-only", "rle", "fixed", "quick", "medium"];
+// Staging buffers of the streams created with the sharedBuffers option. The
+// process calls are synchronous: a stream borrows them for one transform or
+// flush, and allocates its own if a callback re-enters while they are lent.
+let arena;
+
+function _borrow(stream, outBufferSize) {
+	if (!arena || (!arena.lent && arena.outSize < outBufferSize)) {
+		if (arena) {
+			free(arena.in);
+			free(arena.out);
+		}
+		arena = { in: malloc(IN_CHUNK_SIZE), out: malloc(outBufferSize), outSize: outBufferSize, lent: false };
+	}
+	if (arena.lent || arena.outSize < outBufferSize) {
+		stream.in = malloc(IN_CHUNK_SIZE);
+		stream.out = malloc(outBufferSize);
+		stream._shared = false;
+	} else {
+		stream.in = arena.in;
+		stream.out = arena.out;
+		arena.lent = true;
+	}
+	stream.inBufferSize = IN_CHUNK_SIZE;
+}
+
+function _giveBack(stream) {
+	if (stream._shared) {
+		arena.lent = false;
+	} else {
+		// own buffers, unless already freed by _release
+		if (stream.in) {
+			free(stream.in);
+		}
+		if (stream.out) {
+			free(stream.out);
+		}
+		stream._shared = true;
+	}
+	stream.in = stream.out = stream.inBufferSize = 0;
+}
+
+const Z_MEM_ERROR = -4;
+// deflate windowBits/memLevel tried in turn by the "downgrade" memory policy
+const DOWNGRADE_PARAMS = [[14, 7], [13, 6], [12, 5], [10, 4], [9, 3]];
+const admissionQueue = [];
+
+// Sets the memory budget (bytes, 0 for none) that stream initialization
+// reserves from, see wasm_stream_reserve in wasm_stream_common.c. A stream
+// that does not fit waits, in order, for streams to end (memoryPolicy "wait",
+// the default), first tries smaller deflate parameters ("downgrade") or
+// fails ("error").
+export function setMemoryBudget(bytes) {
+	wasm.wasm_set_budget(bytes);
+	_admitPending();
+}
+
+function _admit(stream, downgrade) {
+	if (downgrade) {
+		for (const [windowBits, memLevel] of DOWNGRADE_PARAMS) {
+			const result = stream._init(windowBits, memLevel);
+			if (result !== Z_MEM_ERROR) {
+				return _initialized(stream, result);
+			}
+		}
+	}
+	return new Promise((resolve, reject) => {
+		admissionQueue.push({ stream, resolve, reject });
+		_admitPending();
 	});
 }
 
+function _admitPending() {
+	while (admissionQueue.length) {
+		const { stream, resolve, reject } = admissionQueue[0];
+		const result = stream._init();
+		// only another stream's reservation can make room: otherwise fail
+		if (result === Z_MEM_ERROR && wasm.wasm_budget_shared(stream.streamHandle)) {
+			return;
+		}
+		admissionQueue.shift();
+		try {
+			resolve(_initialized(stream, result));
+		} catch (error) {
+			reject(error);
+		}
+	}
+}
+
+function _initialized(stream, result) {
+	if (result !== 0) {
+		_release(stream);
+		throw new Error("init failed:" + result);
+	}
+}
+
+// A gzip process call stops at the end of each member, so the running totals
+// are the member boundary when the member count moves.
+function _checkMemberEnd(stream, onMemberEnd) {
+	const members = stream._members(stream.streamHandle);
+	if (members !== stream.members) {
+		stream.members = members;
+		if (onMemberEnd) {
+			onMemberEnd({ index: members - 1, inputOffset: stream.totalIn, outputOffset: stream.totalOut });
+		}
+	}
+}
+
+const STATS_FIELDS = ["stored", "fixed", "dynamic", "tables", "cached", "fast", "slow", "windowCopies", "windowBytes"];
+const STATS_BUCKETS = 17;
+
+// Returns the decoding counters of an inflate stream handle (see
+// src/infstats.h), or null unless the module was built with -DINFLATE_STATS.
+// lengths[n] and distances[n] count the matches in [2^n, 2^(n+1)).
+export function getInflateStats(streamHandle, deflate64 = false) {
+	return _readStats(deflate64 ? wasm.inflate9_stats : wasm.inflate_stats, streamHandle);
+}
+
+function _readStats(statsFunction, streamHandle) {
+	const size = (STATS_FIELDS.length + 2 * STATS_BUCKETS) * 4;
+	const ptr = malloc(size);
+	try {
+		if (statsFunction(streamHandle, ptr) !== 0) {
+			return null;
+		}
+		const counters = new Uint32Array(memory.buffer, ptr, size / 4);
+		const stats = {};
+		STATS_FIELDS.forEach((name, index) => stats[name] = counters[index]);
+		stats.lengths = Array.from(counters.subarray(STATS_FIELDS.length, STATS_FIELDS.length + STATS_BUCKETS));
+		stats.distances = Array.from(counters.subarray(STATS_FIELDS.length + STATS_BUCKETS));
+		return stats;
+	} finally {
+		free(ptr);
+	}
+}
+
+const WASM_STATS_FIELDS = ["liveBytes", "peakBytes", "zlibBytes", "inflateContexts", "inflate9Contexts", "deflateContexts", "windows", "freeBytes", "freeChunks", "heapBytes", "memoryBytes", "reservedBytes", "budgetBytes"];
+
+// Heap telemetry of the module, see wasm_stats in wasm_stream_common.c. Buffers
+// allocated with malloc from JS are not counted in liveBytes.
+export function getWasmStats() {
+	if (!wasm || !wasm.wasm_stats) {
+		return null;
+	}
+	const size = WASM_STATS_FIELDS.length * 4;
+	const ptr = malloc(size);
+	try {
+		if (wasm.wasm_stats(ptr) !== 0) {
+			return null;
+		}
+		const counters = new Uint32Array(memory.buffer, ptr, WASM_STATS_FIELDS.length);
+		const stats = {};
+		WASM_STATS_FIELDS.forEach((name, index) => stats[name] = counters[index]);
+		return stats;
+	} finally {
+		free(ptr);
+	}
+}
+
 export class CompressionStreamZlib {
 	constructor(type = "deflate", options) {
 		return _make(true, type, options);
@@ -165,4 +501,506 @@ export class DecompressionStreamZlib {
 	constructor(type = "deflate", options) {
 		return _make(false, type, options);
 	}
-}
\ No newline at end of file
+}
+
+// Decompresses a whole raw deflate ("deflate-raw") or deflate64
+// ("deflate64-raw") entry of a ZIP file into a buffer of its uncompressed
+// size, which is the window of the decoder as in infback9: nothing is copied
+// to a window (see wasm_inflate_back in wasm_stream_common.c). Throws if the
+// entry is corrupt or does not decompress to size bytes.
+export function inflateEntry(data, size, type = "deflate-raw") {
+	const prefix = type === "deflate64-raw" ? "inflate9" : type === "deflate-raw" ? "inflate" : null;
+	if (!prefix) {
+		throw new Error("unsupported type: " + type);
+	}
+	const process = wasm[prefix + "_ring_process"];
+	const last_consumed = wasm[prefix + "_last_consumed"];
+	const streamHandle = wasm[prefix + "_new"]();
+	const inPtr = malloc(data.length || 1);
+	const outPtr = malloc(size || 1);
+	try {
+		let result = wasm[prefix + "_init_raw"](streamHandle);
+		if (result === 0) {
+			result = outPtr ? wasm[prefix + "_back"](streamHandle, outPtr, size) : Z_MEM_ERROR;
+		}
+		if (result !== 0) {
+			throw new Error("init failed:" + result);
+		}
+		new Uint8Array(memory.buffer).set(data, inPtr);
+		let consumed = 0, produced = 0;
+		while (true) {
+			result = process(streamHandle, inPtr + consumed, data.length - consumed, 4);
+			const code = result >> 24;
+			const used = last_consumed(streamHandle);
+			produced += result & 0x00ffffff;
+			consumed += used;
+			if (code === 1) {
+				break;
+			}
+			// Z_BUF_ERROR without progress: truncated, or larger than size
+			if ((code < 0 && code !== -5) || (used === 0 && (result & 0x00ffffff) === 0)) {
+				throw new Error("process error:" + code);
+			}
+		}
+		if (produced !== size) {
+			throw new Error("size mismatch:" + produced);
+		}
+		return new Uint8Array(memory.buffer, outPtr, size).slice();
+	} finally {
+		wasm[prefix + "_end"](streamHandle);
+		free(inPtr);
+		free(outPtr);
+	}
+}
+
+const SEGMENT_BUFFER_SIZE = 64 * 1024;
+const Z_BLOCK = 5;
+const WINDOW_SIZE = 32 * 1024;
+const MIN_SEGMENT_SIZE = 1024 * 1024;
+
+// Decodes one segment of a parallel decompression (see decompressParallel).
+// raw segments start at a full flush point and end at the latest at the end
+// of their gzip member, other segments start at a gzip member. Meant to run
+// in a worker that called setWasmExports() on its own instance.
+export function inflateSegment(task) {
+	const { data, raw, dictionary } = task;
+	const streamHandle = wasm.inflate_new();
+	const inPtr = malloc(SEGMENT_BUFFER_SIZE);
+	const outPtr = malloc(SEGMENT_BUFFER_SIZE);
+	const chunks = [];
+	let consumed = 0, ended = false, members = 0, crc = 0, tailLength = 0, error = 0, dataType = 0;
+	try {
+		let result = raw ? wasm.inflate_init_raw(streamHandle) : wasm.inflate_init_gzip(streamHandle);
+		if (result === 0 && dictionary) {
+			new Uint8Array(memory.buffer).set(dictionary, inPtr);
+			result = wasm.inflate_set_dictionary(streamHandle, inPtr, dictionary.length);
+		}
+		error = result;
+		while (!error) {
+			const toRead = Math.min(data.length - consumed, SEGMENT_BUFFER_SIZE);
+			new Uint8Array(memory.buffer).set(data.subarray(consumed, consumed + toRead), inPtr);
+			// Z_BLOCK: the data type then tells a stop at a block boundary,
+			// such as a flush point, from one inside a block
+			result = wasm.inflate_process(streamHandle, inPtr, toRead, outPtr, SEGMENT_BUFFER_SIZE, Z_BLOCK);
+			const produced = result & 0x00ffffff;
+			const code = result >> 24;
+			const used = wasm.inflate_last_consumed(streamHandle);
+			consumed += used;
+			if (produced) {
+				chunks.push(new Uint8Array(memory.buffer).slice(outPtr, outPtr + produced));
+				crc = wasm.crc32(crc, outPtr, produced) >>> 0;
+				tailLength += produced;
+			}
+			// Z_BUF_ERROR only means that the input is exhausted
+			if (code < 0 && code !== -5) {
+				error = code;
+			} else {
+				if (!raw) {
+					const count = wasm.inflate_members(streamHandle);
+					if (count !== members) {
+						members = count;
+						crc = tailLength = 0;
+					}
+				}
+				ended = code === 1;
+				if ((used === 0 && produced === 0) || (raw && ended)) {
+					break;
+				}
+				// only after progress: a call without input moves past the block
+				// boundary (inflate resumes at TYPEDO)
+				dataType = wasm.inflate_data_type(streamHandle);
+			}
+		}
+	} finally {
+		wasm.inflate_end(streamHandle);
+		free(inPtr);
+		free(outPtr);
+	}
+	return { output: _concat(chunks), consumed, ended, members, crc, tailLength, dataType, error };
+}
+
+// Decompresses a whole gzip (or raw deflate) buffer whose independent parts
+// can be decoded concurrently: concatenated gzip members and blocks that
+// follow a Z_FULL_FLUSH point (empty stored block, 00 00 ff ff). Segments are
+// handed to options.runTask, e.g. a worker pool calling inflateSegment(), at
+// most options.concurrency at a time; the output is emitted in order and the
+// CRC-32 of members split across segments is verified with crc32_combine().
+// Boundaries found by the scan are only candidates: a segment that does not
+// end exactly where the next one starts is merged with it and decoded again
+// with the preceding window as dictionary.
+export function decompressParallel(data, type = "gzip", options = {}) {
+	const gzip = type === "gzip";
+	const concurrency = (typeof options.concurrency === "number") ? options.concurrency : 4;
+	const minSegmentSize = (typeof options.minSegmentSize === "number") ? options.minSegmentSize : MIN_SEGMENT_SIZE;
+	const runTask = (typeof options.runTask === "function") ? options.runTask : inflateSegment;
+	if (gzip && !_isMemberStart(data, 0)) {
+		throw new Error("not a gzip stream");
+	}
+	const segments = _splitSegments(data, gzip, minSegmentSize);
+	// promises of the segments [taken, next)
+	const pending = [];
+	let taken = 0, next = 0;
+	let window = new Uint8Array(0);
+	let crc = 0, length = 0;
+
+	function dispatch() {
+		while (next < segments.length && pending.length < concurrency) {
+			const { start, end, raw } = segments[next++];
+			pending.push(Promise.resolve(runTask({ data: data.slice(start, end), raw })));
+		}
+	}
+
+	function valid({ start, end, raw }, result) {
+		const last = end === data.length;
+		const rest = end - start - result.consumed;
+		if (result.error) {
+			return false;
+		}
+		if (!result.ended) {
+			// stopped on a full flush point: byte aligned, not in the last block
+			return rest === 0 && !last && (result.dataType & 128) && (result.dataType & 127) === 0;
+		}
+		if (raw && gzip) {
+			// more than the trailer: a member merged in, split off by take()
+			return rest === 8 || (rest > 8 && (last || _isMemberStart(data, end - rest + 8)));
+		}
+		return rest === 0 || last;
+	}
+
+	function check({ start, raw }, result) {
+		if (!raw) {
+			crc = length = 0;
+		}
+		crc = wasm.crc32_combine(crc, result.crc, result.tailLength) >>> 0;
+		length += result.tailLength;
+		if (raw && gzip && result.ended) {
+			const view = new DataView(data.buffer, data.byteOffset + start + result.consumed, 8);
+			if (view.getUint32(0, true) !== crc || view.getUint32(4, true) !== (length >>> 0)) {
+				throw new Error("incorrect data check");
+			}
+			crc = length = 0;
+		}
+	}
+
+	async function take() {
+		let segment = segments[taken];
+		let result = await pending.shift();
+		let retried = false;
+		while (!valid(segment, result)) {
+			if (segment.raw && !retried) {
+				// sync flush point: the history is still needed
+				retried = true;
+			} else if (taken + 1 < segments.length) {
+				// false boundary, e.g. a member start found in compressed
+				// data: merge with the following segment
+				if (taken + 1 < next) {
+					pending.shift();
+					next--;
+				}
+				segment = { start: segment.start, end: segments[taken + 1].end, raw: segment.raw };
+				segments.splice(taken, 2, segment);
+			} else {
+				throw new Error("process error:" + (result.error || -3));
+			}
+			result = await runTask({ data: data.slice(segment.start, segment.end), raw: segment.raw, dictionary: segment.raw ? window : null });
+		}
+		const rest = segment.end - segment.start - result.consumed;
+		if (segment.raw && gzip && result.ended && rest > 8 && _isMemberStart(data, segment.end - rest + 8)) {
+			// the members after this one, decoded on their own
+			const member = { start: segment.end - rest + 8, end: segment.end, raw: false };
+			segment.end = member.start;
+			segments.splice(taken + 1, 0, member);
+			pending.unshift(Promise.resolve(runTask({ data: data.slice(member.start, member.end), raw: false })));
+			next++;
+		}
+		check(segment, result);
+		taken++;
+		const output = result.output;
+		window = output.length >= WINDOW_SIZE ? output.slice(output.length - WINDOW_SIZE) :
+			_concat([window.subarray(Math.max(0, window.length + output.length - WINDOW_SIZE)), output]);
+		return output;
+	}
+
+	return new ReadableStream({
+		async pull(controller) {
+			// pull() is not called again until something is enqueued
+			while (true) {
+				dispatch();
+				if (!pending.length) {
+					controller.close();
+					return;
+				}
+				const output = await take();
+				if (output.length) {
+					controller.enqueue(output);
+					return;
+				}
+			}
+		}
+	});
+}
+
+function _isMemberStart(data, offset) {
+	return data[offset] === 0x1f && data[offset + 1] === 0x8b && data[offset + 2] === 8 && (data[offset + 3] & 0xe0) === 0;
+}
+
+// Candidate boundaries: gzip member starts and the byte that follows a full
+// flush marker. Segments are at least minSegmentSize long, except that a raw
+// segment never runs into the next member. Either may be found inside
+// compressed data, see take() in decompressParallel.
+function _splitSegments(data, gzip, minSegmentSize) {
+	const segments = [];
+	let start = 0, raw = !gzip;
+	for (let offset = 1; offset + 4 <= data.length; offset++) {
+		const member = gzip && _isMemberStart(data, offset);
+		const flush = !member && offset >= 4 && data[offset - 4] === 0 && data[offset - 3] === 0 && data[offset - 2] === 0xff && data[offset - 1] === 0xff;
+		if ((member || flush) && (offset - start >= minSegmentSize || (raw && member))) {
+			segments.push({ start, end: offset, raw });
+			start = offset;
+			raw = !member;
+		}
+	}
+	segments.push({ start, end: data.length, raw });
+	return segments;
+}
+
+function _concat(chunks) {
+	if (chunks.length === 1) {
+		return chunks[0];
+	}
+	const result = new Uint8Array(chunks.reduce((size, chunk) => size + chunk.length, 0));
+	let offset = 0;
+	for (const chunk of chunks) {
+		result.set(chunk, offset);
+		offset += chunk.length;
+	}
+	return result;
+}
+
+const SPEC_MARKER = 256;
+const SPEC_LOOKAHEAD = 256 * 1024;
+const Z_BUF_ERROR = -5;
+
+// Decodes raw deflate data from the block at bit task.from, or from the first
+// block found in the next task.search bits, up to the first block boundary at
+// or after bit task.stop (see inflate_spec_decode in inflate_spec_wasm.c).
+// Bytes that depend on the unknown window are returned as markers, resolved
+// by decompressSpeculative(). Meant to run in a worker that called
+// setWasmExports() on its own instance.
+export function inflateSpeculative(task) {
+	const { data, from = 0, search = 0, stop, wsize = WINDOW_SIZE } = task;
+	const streamHandle = wasm.inflate_spec_new();
+	const inPtr = malloc(data.length);
+	try {
+		new Uint8Array(memory.buffer).set(data, inPtr);
+		const error = wasm.inflate_spec_decode(streamHandle, inPtr, data.length, from, search, stop, wsize);
+		if (error) {
+			return { error };
+		}
+		const symbolsPtr = wasm.inflate_spec_symbols(streamHandle);
+		const count = wasm.inflate_spec_count(streamHandle);
+		return {
+			error: 0,
+			start: wasm.inflate_spec_start(streamHandle) >>> 0,
+			stop: wasm.inflate_spec_stop(streamHandle) >>> 0,
+			last: wasm.inflate_spec_last(streamHandle) !== 0,
+			markers: wasm.inflate_spec_markers(streamHandle),
+			symbols: new Uint16Array(memory.buffer, symbolsPtr, count).slice()
+		};
+	} finally {
+		wasm.inflate_spec_end(streamHandle);
+		free(inPtr);
+	}
+}
+
+// Decompresses a single gzip member (or raw deflate stream) by splitting the
+// compressed data into chunks of options.chunkSize bytes that are decoded
+// concurrently without their window, the first block of a chunk being found
+// by trial. The chunks are then chained in order: a chunk is used when it
+// starts where the previous one stopped, its markers being replaced with the
+// last 32K of output. Otherwise, the data up to the next chunk is decoded
+// again sequentially with the known window. Segments are handed to
+// options.runTask (e.g. a worker pool calling inflateSpeculative()), at most
+// options.concurrency at a time.
+export function decompressSpeculative(data, type = "deflate-raw", options = {}) {
+	const gzip = type === "gzip";
+	if (!gzip && type !== "deflate-raw") {
+		throw new Error("unsupported format: " + type);
+	}
+	const concurrency = (typeof options.concurrency === "number") ? options.concurrency : 4;
+	const chunkSize = (typeof options.chunkSize === "number") ? options.chunkSize : MIN_SEGMENT_SIZE;
+	const runTask = (typeof options.runTask === "function") ? options.runTask : inflateSpeculative;
+	const offset = gzip ? _gzipHeaderLength(data) : 0;
+	const chunks = [];
+	for (let start = offset; start < data.length; start += chunkSize) {
+		chunks.push({ start, end: Math.min(start + chunkSize, data.length) });
+	}
+	const pending = [];
+	let next = 0, taken = 0;
+	// bit offset of the next block to output
+	let pos = offset * 8;
+	let done = false, enqueued = false;
+	let window = new Uint8Array(0);
+	let crc = 0, length = 0;
+
+	function dispatch() {
+		while (next < chunks.length && pending.length < concurrency) {
+			const { start, end } = chunks[next];
+			const first = next++ === 0;
+			pending.push(Promise.resolve(runTask({
+				data: data.slice(start, Math.min(data.length, end + SPEC_LOOKAHEAD)),
+				search: first ? 0 : (end - start) * 8,
+				stop: (end - start) * 8,
+				wsize: first ? 0 : WINDOW_SIZE
+			})));
+		}
+	}
+
+	function emit(result, base, controller) {
+		const output = _resolveSymbols(result.symbols, result.markers, window);
+		pos = base * 8 + result.stop;
+		done = result.last;
+		if (gzip) {
+			crc = _crc32(crc, output);
+			length += output.length;
+		}
+		window = output.length >= WINDOW_SIZE ? output.slice(output.length - WINDOW_SIZE) :
+			_concat([window.subarray(Math.max(0, window.length + output.length - WINDOW_SIZE)), output]);
+		if (output.length) {
+			controller.enqueue(output);
+			enqueued = true;
+		}
+	}
+
+	// sequential decoding from pos up to the first block boundary at or after
+	// target, in steps of SPEC_LOOKAHEAD bytes. The input of a step ends
+	// lookahead bytes past its stop, doubled while a block runs past it.
+	function advance(target, controller) {
+		let lookahead = SPEC_LOOKAHEAD;
+		while (!done && pos < target) {
+			const base = Math.floor(pos / 8);
+			const stop = Math.min(target, pos + SPEC_LOOKAHEAD * 8) - base * 8;
+			const end = base + (stop >> 3) + 1 + lookahead;
+			const result = inflateSpeculative({
+				data: data.subarray(base, Math.min(data.length, end)),
+				from: pos - base * 8,
+				stop,
+				wsize: window.length
+			});
+			if (result.error === Z_BUF_ERROR && end < data.length) {
+				lookahead *= 2;
+				continue;
+			}
+			if (result.error) {
+				throw new Error("process error:" + result.error);
+			}
+			emit(result, base, controller);
+		}
+	}
+
+	function finish(controller) {
+		if (gzip) {
+			const trailer = Math.ceil(pos / 8);
+			if (trailer + 8 > data.length) {
+				throw new Error("unexpected end of data");
+			}
+			const view = new DataView(data.buffer, data.byteOffset + trailer, 8);
+			if (view.getUint32(0, true) !== crc || view.getUint32(4, true) !== (length >>> 0)) {
+				throw new Error("incorrect data check");
+			}
+			// members that follow are decoded sequentially
+			if (_isMemberStart(data, trailer + 8)) {
+				const result = inflateSegment({ data: data.subarray(trailer + 8), raw: false });
+				if (result.error || !result.ended) {
+					throw new Error("process error:" + (result.error || -5));
+				}
+				if (result.output.length) {
+					controller.enqueue(result.output);
+				}
+			}
+		}
+		controller.close();
+	}
+
+	return new ReadableStream({
+		async pull(controller) {
+			enqueued = false;
+			// pull() is not called again until something is enqueued
+			while (!enqueued) {
+				if (done || taken === chunks.length) {
+					if (!done) {
+						throw new Error("unexpected end of data");
+					}
+					finish(controller);
+					return;
+				}
+				dispatch();
+				const chunk = chunks[taken++];
+				const result = await pending.shift();
+				const start = chunk.start * 8 + result.start;
+				const valid = !result.error && start >= pos;
+				advance(valid ? start : chunk.end * 8, controller);
+				if (valid && !done && start === pos) {
+					emit(result, chunk.start, controller);
+				}
+			}
+		}
+	});
+}
+
+// Replaces the markers of a speculative decoding with the bytes of the
+// window, right-aligned on WINDOW_SIZE bytes.
+function _resolveSymbols(symbols, markers, window) {
+	const output = new Uint8Array(symbols);
+	if (markers) {
+		const base = SPEC_MARKER + WINDOW_SIZE - window.length;
+		for (let index = 0; index < symbols.length; index++) {
+			const symbol = symbols[index];
+			if (symbol >= SPEC_MARKER) {
+				if (symbol < base) {
+					throw new Error("invalid distance too far back");
+				}
+				output[index] = window[symbol - base];
+			}
+		}
+	}
+	return output;
+}
+
+function _gzipHeaderLength(data) {
+	if (!_isMemberStart(data, 0)) {
+		throw new Error("not a gzip stream");
+	}
+	const flags = data[3];
+	let offset = 10;
+	if (flags & 4) {
+		offset += 2 + (data[offset] | (data[offset + 1] << 8));
+	}
+	if (flags & 8) {
+		while (offset < data.length && data[offset++]);
+	}
+	if (flags & 16) {
+		while (offset < data.length && data[offset++]);
+	}
+	if (flags & 2) {
+		offset += 2;
+	}
+	if (offset >= data.length) {
+		throw new Error("unexpected end of data");
+	}
+	return offset;
+}
+
+function _crc32(crc, bytes) {
+	const ptr = malloc(SEGMENT_BUFFER_SIZE);
+	try {
+		for (let offset = 0; offset < bytes.length; offset += SEGMENT_BUFFER_SIZE) {
+			const piece = bytes.subarray(offset, offset + SEGMENT_BUFFER_SIZE);
+			new Uint8Array(memory.buffer).set(piece, ptr);
+			crc = wasm.crc32(crc, ptr, piece.length) >>> 0;
+		}
+	} finally {
+		free(ptr);
+	}
+	return crc;
+}
@@ -0,0 +1,975 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "zlib.h"
+#include "deflate.h"
+#include "allocator.h"
+#include "deflate_quick.h"
+
+#define QUICK_HASH_BITS 14
+#define QUICK_BLOCK 16384 /* input bytes per block, at most */
+#define QUICK_MIN_MATCH 4
+#define QUICK_MAX_MATCH 258
+#define MEDIUM_HASH_BITS 15
+#define MEDIUM_CHUNK 32768   /* input bytes coded at once, at most */
+#define MEDIUM_SYMBOLS 16384 /* per block, as zlib's lit_bufsize */
+#define PENDING_SIZE(chunk) ((chunk) + (chunk) / 8 + 64)
+
+// Match finding, shared by the three encoders: a multiplicative hash of 4
+// bytes, match lengths measured 8 bytes at a time (XOR, then count trailing
+// zeros to find the first differing byte) and a search of hash chains that
+// prefetches the next link while comparing the current candidate. Positions
+// are absolute, modulo 2^32: a window byte at index i is at position base + i.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define match_prefetch(p) __builtin_prefetch(p)
+#else
+#define match_prefetch(p) ((void)(p))
+#endif
+
+static inline uint32_t match_read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+// hash of the 4 bytes at p, on bits bits (Knuth's multiplicative hash)
+static inline unsigned match_hash4(const unsigned char *p, unsigned bits) {
+  return (match_read32(p) * 2654435761U) >> (32 - bits);
+}
+
+// length of the match of a and b, at most max bytes
+static inline unsigned match_length(const unsigned char *a,
+                                    const unsigned char *b, unsigned max) {
+  unsigned len = 0;
+  while (len + 8 <= max) {
+    uint64_t x, y;
+    memcpy(&x, a + len, 8);
+    memcpy(&y, b + len, 8);
+    if (x != y) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      return len + ((unsigned)__builtin_clzll(x ^ y) >> 3);
+#else
+      return len + ((unsigned)__builtin_ctzll(x ^ y) >> 3);
+#endif
+    }
+    len += 8;
+  }
+  while (len < max && a[len] == b[len])
+    len++;
+  return len;
+}
+
+// Hash chains: head[h] is the last position of hash h, and prev[p & mask]
+// the position before p with the same hash. A link that does not go back
+// was overwritten by a later position: it ends the chain.
+struct match_chain {
+  const unsigned char *window;
+  uint32_t base;    /* position of window[0] */
+  uint32_t *head;
+  uint32_t *prev;   /* mask + 1 entries */
+  unsigned mask;
+  unsigned max_dist; /* farthest match */
+  unsigned depth;    /* candidates tried per search, at least 1 */
+  unsigned nice;     /* a match this long ends the search */
+};
+
+// Insert the position of window[i], of hash h, in front of its chain
+static inline void match_insert(struct match_chain *mc, unsigned i,
+                                unsigned h) {
+  uint32_t at = mc->base + i;
+  mc->prev[at & mc->mask] = mc->head[h];
+  mc->head[h] = at;
+}
+
+// Longest match of window[i] found in the chain starting at position cand,
+// of at most max bytes, 4 <= max: *dist and its length if longer than best,
+// which must be below max, or best.
+static inline unsigned match_longest(const struct match_chain *mc, unsigned i,
+                                     uint32_t cand, unsigned max,
+                                     unsigned best, unsigned *dist) {
+  const unsigned char *cur = mc->window + i;
+  uint32_t at = mc->base + i;
+  unsigned limit = i < mc->max_dist ? i : mc->max_dist;
+  unsigned depth = mc->depth;
+  uint32_t d = at - cand;
+  while (d - 1 < limit) {
+    uint32_t next = mc->prev[cand & mc->mask];
+    if (at - next - 1 < limit) {
+      match_prefetch(&mc->prev[next & mc->mask]);
+      match_prefetch(cur - (at - next));
+    }
+    const unsigned char *m = cur - d;
+    // the byte that would make the match longer first, then the first 4
+    if (m[best] == cur[best] && match_read32(m) == match_read32(cur)) {
+      unsigned len = 4 + match_length(cur + 4, m + 4, max - 4);
+      if (len > best) {
+        best = len;
+        *dist = d;
+        if (len >= mc->nice || len == max)
+          break;
+      }
+    }
+    if (--depth == 0 || at - next <= d)
+      break;
+    cand = next;
+    d = at - cand;
+  }
+  return best;
+}
+
+// The matches of window[i] in the chain starting at position cand that are
+// longer than all the nearer ones, of at least 4 and at most max bytes, 4 <=
+// max: at most n of them in found[], as dist | len << 16, nearest first. The
+// nearest match of any length up to that of found[k] is then at the distance
+// of found[k], or nearer when more than n were found and the last ones were
+// merged. Returns their number.
+static inline unsigned match_frontier(const struct match_chain *mc,
+                                      unsigned i, uint32_t cand, unsigned max,
+                                      uint32_t *found, unsigned n) {
+  const unsigned char *cur = mc->window + i;
+  uint32_t at = mc->base + i;
+  unsigned limit = i < mc->max_dist ? i : mc->max_dist;
+  unsigned depth = mc->depth, best = 3, count = 0;
+  uint32_t d = at - cand;
+  while (d - 1 < limit) {
+    uint32_t next = mc->prev[cand & mc->mask];
+    if (at - next - 1 < limit) {
+      match_prefetch(&mc->prev[next & mc->mask]);
+      match_prefetch(cur - (at - next));
+    }
+    const unsigned char *m = cur - d;
+    if (m[best] == cur[best] && match_read32(m) == match_read32(cur)) {
+      unsigned len = 4 + match_length(cur + 4, m + 4, max - 4);
+      if (len > best) {
+        best = len;
+        if (count == n)
+          count--;
+        found[count++] = d | (uint32_t)len << 16;
+        if (len >= mc->nice || len == max)
+          break;
+      }
+    }
+    if (--depth == 0 || at - next <= d)
+      break;
+    cand = next;
+    d = at - cand;
+  }
+  return count;
+}
+
+// Medium levels 3 to 5: candidates tried per search, length that ends it,
+// matches shorter than lazy are checked against one at the next byte, and
+// the positions of those longer than insert are not hashed.
+static const struct {
+  uint16_t depth, nice, lazy, insert;
+} medium_params[3] = {{4, 32, 8, 16}, {8, 64, 16, 32}, {24, 128, 32, 64}};
+
+// Optimal levels 10 to 12: candidates tried per search, and parses of each
+// chunk, the first with the costs of the previous chunk.
+#define OPTIMAL_MATCHES 4 /* kept per position, see match_frontier */
+static const struct {
+  uint16_t depth, passes;
+} optimal_params[3] = {{128, 4}, {256, 10}, {1024, 20}};
+
+enum { QUICK_HEADER, QUICK_RUN, QUICK_DONE };
+
+struct deflate_quick {
+  int wrap;   /* 0: raw, 1: zlib, 2: gzip */
+  int bits;   /* window bits */
+  int status; /* QUICK_HEADER, QUICK_RUN or QUICK_DONE */
+  int dirty;  /* input taken since the last flush marker */
+  int level;  /* 1: quick, 3 to 5: medium, 10 to 12: optimal */
+  unsigned chunk;     /* input bytes coded at once */
+  unsigned hash_bits; /* of head */
+  unsigned wsize;
+  unsigned char *window; /* 2 * wsize bytes, the input at base */
+  uint32_t *head;        /* last position of each hash of 4 bytes */
+  uint32_t *prev;        /* medium: the hash chains, wsize entries */
+  unsigned hashed;       /* medium: window index of the next to insert */
+  deflate_state *trees;  /* medium: trees.c's block coder */
+  struct optimal *opt;   /* optimal: the parser's buffers */
+  uint32_t base;         /* position of window[0] in the input, mod 2^32 */
+  unsigned fill;         /* bytes in window coded */
+  unsigned lookahead;    /* bytes after them, not coded yet */
+  unsigned char *pending;
+  unsigned pending_len;
+  unsigned pending_out;
+  uint64_t bi_buf; /* bits not written yet, from bit 0 */
+  unsigned bi_valid;
+};
+
+// Fixed Huffman codes, bit reversed: literal/length symbols, then the codes
+// and extra bits of the match lengths, one entry per length.
+static uint16_t lit_code[288];
+static uint8_t lit_len[288];
+static uint32_t len_code[QUICK_MAX_MATCH + 1];
+static uint8_t len_bits[QUICK_MAX_MATCH + 1];
+static uint8_t dist_rev[30];
+static int tables_built;
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+static unsigned reverse(unsigned code, int len) {
+  unsigned r = 0;
+  while (len--) {
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  return r;
+}
+
+static void build_tables(void) {
+  for (unsigned n = 0; n < 288; n++) {
+    unsigned code, len;
+    if (n < 144) {
+      code = 0x30 + n;
+      len = 8;
+    } else if (n < 256) {
+      code = 0x190 + n - 144;
+      len = 9;
+    } else if (n < 280) {
+      code = n - 256;
+      len = 7;
+    } else {
+      code = 0xc0 + n - 280;
+      len = 8;
+    }
+    lit_code[n] = (uint16_t)reverse(code, len);
+    lit_len[n] = (uint8_t)len;
+  }
+  unsigned length = 3;
+  for (unsigned i = 0; i < 28; i++)
+    for (unsigned k = 0; k < (1U << length_extra[i]); k++, length++) {
+      len_code[length] = lit_code[257 + i] | (k << lit_len[257 + i]);
+      len_bits[length] = (uint8_t)(lit_len[257 + i] + length_extra[i]);
+    }
+  // 258 has its own code (285) instead of the last one of code 284
+  len_code[QUICK_MAX_MATCH] = lit_code[285];
+  len_bits[QUICK_MAX_MATCH] = lit_len[285];
+  for (unsigned d = 0; d < 30; d++)
+    dist_rev[d] = (uint8_t)reverse(d, 5);
+  tables_built = 1;
+}
+
+static void out_byte(struct deflate_quick *q, unsigned c) {
+  q->pending[q->pending_len++] = (unsigned char)c;
+}
+
+// len <= 32, flushing full words: bi_valid stays below 32 between calls
+static void put_bits(struct deflate_quick *q, uint32_t value, unsigned len) {
+  q->bi_buf |= (uint64_t)value << q->bi_valid;
+  q->bi_valid += len;
+  if (q->bi_valid >= 32) {
+    uint32_t w = (uint32_t)q->bi_buf;
+    out_byte(q, w);
+    out_byte(q, w >> 8);
+    out_byte(q, w >> 16);
+    out_byte(q, w >> 24);
+    q->bi_buf >>= 32;
+    q->bi_valid -= 32;
+  }
+}
+
+static void align_bits(struct deflate_quick *q) {
+  while (q->bi_valid > 0) {
+    out_byte(q, (unsigned)q->bi_buf);
+    q->bi_buf >>= 8;
+    q->bi_valid = q->bi_valid > 8 ? q->bi_valid - 8 : 0;
+  }
+  q->bi_buf = 0;
+}
+
+static void put_match(struct deflate_quick *q, unsigned len, unsigned dist) {
+  unsigned d = dist - 1, code, extra = 0;
+  if (d < 4) {
+    code = d;
+  } else {
+    extra = 31 - (unsigned)__builtin_clz(d) - 1;
+    code = 2 * (extra + 1) + ((d >> extra) & 1);
+  }
+  put_bits(q, len_code[len], len_bits[len]);
+  put_bits(q, dist_rev[code] | ((d & ((1U << extra) - 1)) << 5), 5 + extra);
+}
+
+// Code the n bytes at window[fill] in one block, after the previous ones
+static void quick_block(struct deflate_quick *q, unsigned n) {
+  unsigned start_len = q->pending_len, start_valid = q->bi_valid;
+  uint64_t start_buf = q->bi_buf;
+  const unsigned char *w = q->window;
+  unsigned pos = q->fill, end = q->fill + n;
+  put_bits(q, 1 << 1, 3); // not last, fixed codes
+  while (pos < end) {
+    if (end - pos >= QUICK_MIN_MATCH) {
+      uint32_t *head = &q->head[match_hash4(w + pos, QUICK_HASH_BITS)];
+      uint32_t dist = q->base + pos - *head;
+      *head = q->base + pos;
+      if (dist - 1 < q->wsize && dist <= pos &&
+          match_read32(w + pos) == match_read32(w + pos - dist)) {
+        unsigned max = end - pos < QUICK_MAX_MATCH ? end - pos
+                                                   : QUICK_MAX_MATCH;
+        unsigned len = QUICK_MIN_MATCH +
+                       match_length(w + pos + QUICK_MIN_MATCH,
+                                    w + pos - dist + QUICK_MIN_MATCH,
+                                    max - QUICK_MIN_MATCH);
+        put_match(q, len, dist);
+        pos += len;
+        continue;
+      }
+    }
+    put_bits(q, lit_code[w[pos]], lit_len[w[pos]]);
+    pos++;
+  }
+  put_bits(q, lit_code[256], lit_len[256]);
+  unsigned bits = (q->pending_len - start_len) * 8 + q->bi_valid - start_valid;
+  if (bits > (n + 5) * 8 + 3) {
+    // stored block instead: header, then aligned length and data
+    q->pending_len = start_len;
+    q->bi_buf = start_buf;
+    q->bi_valid = start_valid;
+    put_bits(q, 0, 3);
+    align_bits(q);
+    out_byte(q, n);
+    out_byte(q, n >> 8);
+    out_byte(q, ~n);
+    out_byte(q, ~n >> 8);
+    memcpy(q->pending + q->pending_len, w + q->fill, n);
+    q->pending_len += n;
+  }
+  q->fill = end;
+}
+
+// Medium chunks are coded by trees.c, in the pending buffer and with the bit
+// buffer handed over in both directions: trees.c keeps less than 16 bits.
+static void trees_begin(struct deflate_quick *q, z_streamp strm) {
+  deflate_state *s = q->trees;
+  while (q->bi_valid >= 8) {
+    out_byte(q, (unsigned)q->bi_buf);
+    q->bi_buf >>= 8;
+    q->bi_valid -= 8;
+  }
+  s->strm = strm;
+  s->pending_buf = q->pending + q->pending_len;
+  s->pending = 0;
+  s->bi_buf = (ush)q->bi_buf;
+  s->bi_valid = (int)q->bi_valid;
+}
+
+static void trees_end(struct deflate_quick *q) {
+  deflate_state *s = q->trees;
+  q->pending_len += (unsigned)s->pending;
+  q->bi_buf = s->bi_buf;
+  q->bi_valid = (unsigned)s->bi_valid;
+}
+
+// Tally the length bytes at window[pos], a literal if distance is 0, and code
+// the block that ends with them if the symbol buffer is full
+static void trees_tally(struct deflate_quick *q, unsigned *block, unsigned pos,
+                        unsigned length, unsigned distance) {
+  deflate_state *s = q->trees;
+  int full;
+  if (distance == 0) {
+    _tr_tally_lit(s, q->window[pos], full);
+  } else {
+    _tr_tally_dist(s, distance, length - MIN_MATCH, full);
+  }
+  if (full) {
+    _tr_flush_block(s, (charf *)q->window + *block, pos + length - *block, 0);
+    *block = pos + length;
+  }
+}
+
+// Insert the positions from hashed to i in the chains: the head of the hash
+// of i before it was inserted
+static uint32_t medium_insert(struct deflate_quick *q, struct match_chain *mc,
+                              unsigned i) {
+  unsigned h;
+  for (; q->hashed < i; q->hashed++)
+    match_insert(mc, q->hashed,
+                 match_hash4(q->window + q->hashed, MEDIUM_HASH_BITS));
+  h = match_hash4(q->window + i, MEDIUM_HASH_BITS);
+  uint32_t cand = q->head[h];
+  match_insert(mc, i, h);
+  q->hashed = i + 1;
+  return cand;
+}
+
+// Code the n bytes at window[fill] after the previous ones, in blocks of
+// MEDIUM_SYMBOLS symbols at most. A match found at a byte is compared with
+// one at the next byte only if it is shorter than lazy, and grows back over
+// the literals before it that it also matches.
+static void medium_chunk(struct deflate_quick *q, z_streamp strm,
+                         unsigned n) {
+  const unsigned char *w = q->window;
+  unsigned lazy = medium_params[q->level - 3].lazy;
+  unsigned insert = medium_params[q->level - 3].insert;
+  struct match_chain mc = {w,
+                           q->base,
+                           q->head,
+                           q->prev,
+                           q->wsize - 1,
+                           q->wsize - MIN_LOOKAHEAD,
+                           medium_params[q->level - 3].depth,
+                           medium_params[q->level - 3].nice};
+  unsigned pos = q->fill, end = q->fill + n, lit = pos, block = pos;
+  trees_begin(q, strm);
+  while (pos + QUICK_MIN_MATCH <= end) {
+    unsigned max = end - pos < QUICK_MAX_MATCH ? end - pos : QUICK_MAX_MATCH;
+    unsigned distance = 0;
+    unsigned length = match_longest(&mc, pos, medium_insert(q, &mc, pos),
+                                    max, QUICK_MIN_MATCH - 1, &distance);
+    if (length < QUICK_MIN_MATCH) {
+      pos++;
+      continue;
+    }
+    // match_longest needs best below max: a match to end has nothing to gain
+    if (length < lazy && length + 1 < end - pos) {
+      unsigned next_distance = 0;
+      max = end - pos - 1 < QUICK_MAX_MATCH ? end - pos - 1 : QUICK_MAX_MATCH;
+      unsigned next = match_longest(&mc, pos + 1,
+                                    medium_insert(q, &mc, pos + 1), max,
+                                    length, &next_distance);
+      if (next > length) {
+        pos++;
+        length = next;
+        distance = next_distance;
+      }
+    }
+    while (pos > lit && distance < pos && length < QUICK_MAX_MATCH &&
+           w[pos - 1] == w[pos - 1 - distance]) {
+      pos--;
+      length++;
+    }
+    for (; lit < pos; lit++)
+      trees_tally(q, &block, lit, 1, 0);
+    trees_tally(q, &block, pos, length, distance);
+    pos += length;
+    lit = pos;
+    if (length > insert)
+      q->hashed = pos; // not worth the time on long matches
+  }
+  for (; lit < end; lit++)
+    trees_tally(q, &block, lit, 1, 0);
+  if (block < end)
+    _tr_flush_block(q->trees, (charf *)w + block, end - block, 0);
+  trees_end(q);
+  q->fill = end;
+}
+
+// The optimal parser finds the matches of every position of a chunk, then
+// the sequence of literals and matches that costs the fewest bits to code
+// them (a shortest path), with the cost of each symbol estimated from its
+// frequency in the previous parse. Each pass refines the estimate, and the
+// parse of the smallest estimated size is coded.
+struct optimal {
+  uint32_t *found;  /* OPTIMAL_MATCHES per position, see match_frontier */
+  uint8_t *count;   /* matches found per position */
+  float *cost;      /* bits to code the chunk up to each position */
+  uint32_t *step;   /* the last symbol on that path, dist | len << 16 */
+  uint32_t *path[2]; /* the parse of a pass and the best one, in order */
+  int primed;       /* freq holds the frequencies of a previous chunk */
+  uint32_t lit_freq[L_CODES];
+  uint32_t dist_freq[D_CODES];
+};
+
+static void optimal_free(struct optimal *o) {
+  if (!o)
+    return;
+  my_zfree(Z_NULL, o->found);
+  my_zfree(Z_NULL, o->count);
+  my_zfree(Z_NULL, o->cost);
+  my_zfree(Z_NULL, o->step);
+  my_zfree(Z_NULL, o->path[0]);
+  my_zfree(Z_NULL, o->path[1]);
+  my_zfree(Z_NULL, o);
+}
+
+static struct optimal *optimal_new(unsigned chunk) {
+  struct optimal *o =
+      (struct optimal *)my_zalloc(Z_NULL, 1, sizeof(struct optimal));
+  if (!o)
+    return NULL;
+  memset(o, 0, sizeof(*o));
+  o->found = (uint32_t *)my_zalloc(Z_NULL, chunk,
+                                   OPTIMAL_MATCHES * sizeof(uint32_t));
+  o->count = (uint8_t *)my_zalloc(Z_NULL, chunk, 1);
+  o->cost = (float *)my_zalloc(Z_NULL, chunk + 1, sizeof(float));
+  o->step = (uint32_t *)my_zalloc(Z_NULL, chunk + 1, sizeof(uint32_t));
+  o->path[0] = (uint32_t *)my_zalloc(Z_NULL, chunk, sizeof(uint32_t));
+  o->path[1] = (uint32_t *)my_zalloc(Z_NULL, chunk, sizeof(uint32_t));
+  if (!o->found || !o->count || !o->cost || !o->step || !o->path[0] ||
+      !o->path[1]) {
+    optimal_free(o);
+    return NULL;
+  }
+  return o;
+}
+
+// Bits per symbol, with the extra bits: -log2 of the frequencies of o, or
+// the fixed codes before the first parse. Unused symbols cost as much as one
+// seen once, and none less than the 1 bit of the shortest Huffman code.
+static void optimal_costs(const struct optimal *o, float *lit_cost,
+                          float *len_cost, float *dist_cost) {
+  if (!o->primed) {
+    for (unsigned n = 0; n < L_CODES; n++)
+      lit_cost[n] = lit_len[n];
+    for (unsigned n = 0; n < D_CODES; n++)
+      dist_cost[n] = 5;
+  } else {
+    uint32_t lit_total = 0, dist_total = 0;
+    for (unsigned n = 0; n < L_CODES; n++)
+      lit_total += o->lit_freq[n];
+    for (unsigned n = 0; n < D_CODES; n++)
+      dist_total += o->dist_freq[n];
+    float lit_log = log2f((float)lit_total + 1);
+    float dist_log = log2f((float)dist_total + 1);
+    for (unsigned n = 0; n < L_CODES; n++) {
+      lit_cost[n] = o->lit_freq[n] ? lit_log - log2f((float)o->lit_freq[n])
+                                   : lit_log;
+      if (lit_cost[n] < 1)
+        lit_cost[n] = 1;
+    }
+    for (unsigned n = 0; n < D_CODES; n++) {
+      dist_cost[n] = o->dist_freq[n]
+                         ? dist_log - log2f((float)o->dist_freq[n])
+                         : dist_log;
+      if (dist_cost[n] < 1)
+        dist_cost[n] = 1;
+    }
+  }
+  for (unsigned n = 0; n < D_CODES; n++)
+    dist_cost[n] += n < 4 ? 0 : n / 2 - 1;
+  for (unsigned len = MIN_MATCH; len <= MAX_MATCH; len++) {
+    unsigned code = _length_code[len - MIN_MATCH];
+    len_cost[len] = lit_cost[LITERALS + 1 + code] + length_extra[code];
+  }
+}
+
+// Frequencies of the n symbols of path in o, and the size in bits that
+// they give to a block, from their entropy
+static float optimal_count(struct optimal *o, const uint32_t *path,
+                           unsigned n) {
+  memset(o->lit_freq, 0, sizeof(o->lit_freq));
+  memset(o->dist_freq, 0, sizeof(o->dist_freq));
+  o->lit_freq[LITERALS] = 1; // the end of block
+  float bits = 0;
+  for (unsigned k = 0; k < n; k++) {
+    unsigned dist = path[k] & 0xffff, len = path[k] >> 16;
+    if (dist == 0) {
+      o->lit_freq[len]++;
+    } else {
+      unsigned lcode = _length_code[len - MIN_MATCH];
+      unsigned dcode = d_code(dist - 1);
+      o->lit_freq[LITERALS + 1 + lcode]++;
+      o->dist_freq[dcode]++;
+      bits += length_extra[lcode] + (dcode < 4 ? 0 : dcode / 2 - 1);
+    }
+  }
+  o->primed = 1;
+  float lit_cost[L_CODES], len_cost[MAX_MATCH + 1], dist_cost[D_CODES];
+  optimal_costs(o, lit_cost, len_cost, dist_cost);
+  for (unsigned c = 0; c < L_CODES; c++)
+    bits += o->lit_freq[c] * lit_cost[c];
+  for (unsigned c = 0; c < D_CODES; c++)
+    bits += o->dist_freq[c] * (dist_cost[c] - (c < 4 ? 0 : c / 2 - 1));
+  return bits;
+}
+
+// Cheapest parse of the n bytes at w with the costs of o, in path as
+// dist | len << 16, a literal with dist 0 and the byte for len. Returns the
+// number of symbols.
+static unsigned optimal_parse(struct optimal *o, const unsigned char *w,
+                              unsigned n, uint32_t *path) {
+  float lit_cost[L_CODES], len_cost[MAX_MATCH + 1], dist_cost[D_CODES];
+  optimal_costs(o, lit_cost, len_cost, dist_cost);
+  float *cost = o->cost;
+  cost[0] = 0;
+  for (unsigned i = 1; i <= n; i++)
+    cost[i] = 1e30f;
+  for (unsigned i = 0; i < n; i++) {
+    float c = cost[i] + lit_cost[w[i]];
+    if (c < cost[i + 1]) {
+      cost[i + 1] = c;
+      o->step[i + 1] = 1U << 16;
+    }
+    // every length up to that of a match is a match at its distance
+    unsigned len = MIN_MATCH;
+    for (unsigned k = 0; k < o->count[i]; k++) {
+      uint32_t found = o->found[i * OPTIMAL_MATCHES + k];
+      unsigned dist = found & 0xffff, longest = found >> 16;
+      float base = cost[i] + dist_cost[d_code(dist - 1)];
+      for (; len <= longest; len++) {
+        c = base + len_cost[len];
+        if (c < cost[i + len]) {
+          cost[i + len] = c;
+          o->step[i + len] = dist | (uint32_t)len << 16;
+        }
+      }
+    }
+  }
+  // back from the end, then in order
+  unsigned symbols = 0;
+  for (unsigned i = n; i > 0; i -= o->step[i] >> 16)
+    path[symbols++] = o->step[i];
+  for (unsigned k = 0; k < symbols / 2; k++) {
+    uint32_t t = path[k];
+    path[k] = path[symbols - 1 - k];
+    path[symbols - 1 - k] = t;
+  }
+  for (unsigned k = 0, i = 0; k < symbols; k++) {
+    if ((path[k] & 0xffff) == 0)
+      path[k] = w[i] << 16;
+    i += (path[k] & 0xffff) == 0 ? 1 : path[k] >> 16;
+  }
+  return symbols;
+}
+
+// Code the n bytes at window[fill] after the previous ones with the best of
+// the parses of the optimal parser
+static void optimal_chunk(struct deflate_quick *q, z_streamp strm,
+                          unsigned n) {
+  struct optimal *o = q->opt;
+  const unsigned char *w = q->window;
+  struct match_chain mc = {w,
+                           q->base,
+                           q->head,
+                           q->prev,
+                           q->wsize - 1,
+                           q->wsize - MIN_LOOKAHEAD,
+                           optimal_params[q->level - 10].depth,
+                           MAX_MATCH};
+  unsigned start = q->fill, end = q->fill + n;
+  for (unsigned i = 0; i < n; i++) {
+    unsigned pos = start + i;
+    o->count[i] = 0;
+    if (pos + QUICK_MIN_MATCH <= end) {
+      unsigned max = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+      o->count[i] = (uint8_t)match_frontier(
+          &mc, pos, medium_insert(q, &mc, pos), max,
+          o->found + i * OPTIMAL_MATCHES, OPTIMAL_MATCHES);
+    }
+  }
+  float best = 0;
+  unsigned symbols = 0;
+  for (unsigned pass = 0; pass < optimal_params[q->level - 10].passes;
+       pass++) {
+    unsigned count = optimal_parse(o, w + start, n, o->path[0]);
+    float bits = optimal_count(o, o->path[0], count);
+    if (pass == 0 || bits < best) {
+      uint32_t *t = o->path[1];
+      o->path[1] = o->path[0];
+      o->path[0] = t;
+      best = bits;
+      symbols = count;
+    }
+  }
+  // the next chunk starts from the costs of the one coded
+  optimal_count(o, o->path[1], symbols);
+  unsigned pos = start, block = start;
+  trees_begin(q, strm);
+  for (unsigned k = 0; k < symbols; k++) {
+    unsigned dist = o->path[1][k] & 0xffff;
+    unsigned len = dist ? o->path[1][k] >> 16 : 1;
+    trees_tally(q, &block, pos, len, dist);
+    pos += len;
+  }
+  if (block < end)
+    _tr_flush_block(q->trees, (charf *)w + block, end - block, 0);
+  trees_end(q);
+  q->fill = end;
+}
+
+// Add input to the lookahead, up to a chunk, sliding the window if needed.
+// Input is coded a chunk at a time, whatever the size of the calls, and a
+// partial chunk only on a flush.
+static void quick_read(struct deflate_quick *q, z_streamp strm) {
+  unsigned n = strm->avail_in;
+  if (n > q->chunk - q->lookahead)
+    n = q->chunk - q->lookahead;
+  if (q->fill + q->lookahead + n > 2 * q->wsize) {
+    unsigned keep = q->wsize;
+    memmove(q->window, q->window + q->fill - keep, keep + q->lookahead);
+    q->base += q->fill - keep;
+    q->hashed -= q->fill - keep;
+    q->fill = keep;
+  }
+  memcpy(q->window + q->fill + q->lookahead, strm->next_in, n);
+  if (q->wrap == 2)
+    strm->adler = crc32(strm->adler, strm->next_in, n);
+  else if (q->wrap == 1)
+    strm->adler = adler32(strm->adler, strm->next_in, n);
+  strm->next_in += n;
+  strm->avail_in -= n;
+  strm->total_in += n;
+  q->lookahead += n;
+}
+
+static void quick_header(struct deflate_quick *q, z_streamp strm) {
+  if (q->wrap == 2) {
+    static const unsigned char gzip[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 4,
+                                           OS_CODE};
+    memcpy(q->pending + q->pending_len, gzip, sizeof(gzip));
+    q->pending_len += sizeof(gzip);
+    strm->adler = crc32(0L, Z_NULL, 0);
+  } else if (q->wrap == 1) {
+    unsigned header = ((q->bits - 8) << 12) | (Z_DEFLATED << 8);
+    // FLEVEL as zlib sets it for the level
+    unsigned flevel = q->level < 2    ? 0
+                      : q->level < 6  ? 1
+                      : q->level == 6 ? 2
+                                      : 3;
+    header |= flevel << 6;
+    header += 31 - header % 31;
+    out_byte(q, header >> 8);
+    out_byte(q, header);
+    strm->adler = adler32(0L, Z_NULL, 0);
+  }
+  strm->data_type = Z_UNKNOWN;
+  q->status = QUICK_RUN;
+}
+
+static void quick_trailer(struct deflate_quick *q, z_streamp strm) {
+  put_bits(q, 1 | (1 << 1), 3); // an empty last block
+  put_bits(q, lit_code[256], lit_len[256]);
+  align_bits(q);
+  uLong check = strm->adler;
+  if (q->wrap == 2) {
+    for (int i = 0; i < 4; i++)
+      out_byte(q, check >> (8 * i));
+    for (int i = 0; i < 4; i++)
+      out_byte(q, strm->total_in >> (8 * i));
+  } else if (q->wrap == 1) {
+    for (int i = 3; i >= 0; i--)
+      out_byte(q, check >> (8 * i));
+  }
+  q->status = QUICK_DONE;
+}
+
+// trees.c's state, of which only the fields of the block coder are set
+static deflate_state *trees_new(struct deflate_quick *q) {
+  deflate_state *s = (deflate_state *)my_zalloc(Z_NULL, 1, sizeof(*s));
+  if (!s)
+    return NULL;
+  memset(s, 0, sizeof(*s));
+  s->level = q->level;
+  s->strategy = Z_DEFAULT_STRATEGY;
+  s->w_size = q->wsize;
+  s->lit_bufsize = MEDIUM_SYMBOLS;
+#ifdef LIT_MEM
+  s->d_buf = (ushf *)my_zalloc(Z_NULL, MEDIUM_SYMBOLS, sizeof(ush));
+  s->l_buf = (uchf *)my_zalloc(Z_NULL, MEDIUM_SYMBOLS, 1);
+  s->sym_end = MEDIUM_SYMBOLS;
+  if (!s->d_buf || !s->l_buf) {
+    my_zfree(Z_NULL, s->d_buf);
+    my_zfree(Z_NULL, s->l_buf);
+#else
+  s->sym_buf = (uchf *)my_zalloc(Z_NULL, MEDIUM_SYMBOLS, 3);
+  s->sym_end = MEDIUM_SYMBOLS * 3;
+  if (!s->sym_buf) {
+#endif
+    my_zfree(Z_NULL, s);
+    return NULL;
+  }
+  _tr_init(s);
+  return s;
+}
+
+static void trees_free(deflate_state *s) {
+  if (!s)
+    return;
+#ifdef LIT_MEM
+  my_zfree(Z_NULL, s->d_buf);
+  my_zfree(Z_NULL, s->l_buf);
+#else
+  my_zfree(Z_NULL, s->sym_buf);
+#endif
+  my_zfree(Z_NULL, s);
+}
+
+static int quick_alloc(struct deflate_quick *q) {
+  q->window = (unsigned char *)my_zalloc(Z_NULL, q->wsize, 2);
+  q->head = (uint32_t *)my_zalloc(Z_NULL, 1U << q->hash_bits,
+                                  sizeof(uint32_t));
+  q->pending = (unsigned char *)my_zalloc(Z_NULL, PENDING_SIZE(q->chunk), 1);
+  if (q->level >= 3) {
+    q->prev = (uint32_t *)my_zalloc(Z_NULL, q->wsize, sizeof(uint32_t));
+    q->trees = trees_new(q);
+  }
+  if (q->level >= 10)
+    q->opt = optimal_new(q->chunk);
+  if (!q->window || !q->head || !q->pending ||
+      (q->level >= 3 && (!q->prev || !q->trees)) ||
+      (q->level >= 10 && !q->opt)) {
+    deflate_quick_release(q);
+    return Z_MEM_ERROR;
+  }
+  // positions wsize + 1 behind are never matched
+  for (unsigned i = 0; i < (1U << q->hash_bits); i++)
+    q->head[i] = q->base - q->wsize - 1;
+  return Z_OK;
+}
+
+static void quick_params(struct deflate_quick *q, int window_bits,
+                         int level) {
+  q->wrap = window_bits < 0 ? 0 : window_bits > 15 ? 2 : 1;
+  q->bits = window_bits < 0 ? -window_bits : window_bits & 15;
+  if (q->bits < 9)
+    q->bits = 9;
+  q->wsize = 1U << q->bits;
+  q->dirty = 1;
+  q->level = level >= 10 ? (level > 12 ? 12 : level)
+             : level < 3 ? 1
+             : level > 5 ? 5
+                         : level;
+  q->chunk = q->level >= 3 ? MEDIUM_CHUNK : QUICK_BLOCK;
+  if (q->chunk > q->wsize)
+    q->chunk = q->wsize;
+  q->hash_bits = q->level >= 3 ? MEDIUM_HASH_BITS : QUICK_HASH_BITS;
+}
+
+struct deflate_quick *deflate_quick_new(int window_bits, int level) {
+  if (!tables_built)
+    build_tables();
+  struct deflate_quick *q =
+      (struct deflate_quick *)my_zalloc(Z_NULL, 1, sizeof(*q));
+  if (!q)
+    return NULL;
+  memset(q, 0, sizeof(*q));
+  quick_params(q, window_bits, level);
+  if (quick_alloc(q) != Z_OK) {
+    my_zfree(Z_NULL, q);
+    return NULL;
+  }
+  return q;
+}
+
+// What quick_alloc and deflate_quick_new allocate
+size_t deflate_quick_cost(int window_bits, int level) {
+  struct deflate_quick q;
+  memset(&q, 0, sizeof(q));
+  quick_params(&q, window_bits, level);
+  size_t cost = sizeof(q) + 2 * (size_t)q.wsize +
+                (sizeof(uint32_t) << q.hash_bits) + PENDING_SIZE(q.chunk);
+  if (q.level >= 3)
+    cost += q.wsize * sizeof(uint32_t) + sizeof(deflate_state) +
+            MEDIUM_SYMBOLS * 3;
+  if (q.level >= 10)
+    cost += sizeof(struct optimal) +
+            q.chunk * (OPTIMAL_MATCHES * sizeof(uint32_t) + 1 +
+                       2 * sizeof(uint32_t)) +
+            (q.chunk + 1) * (sizeof(float) + sizeof(uint32_t));
+  return cost;
+}
+
+int deflate_quick_end(struct deflate_quick *q) {
+  int r = q->status == QUICK_RUN ? Z_DATA_ERROR : Z_OK;
+  deflate_quick_release(q);
+  my_zfree(Z_NULL, q);
+  return r;
+}
+
+int deflate_quick(struct deflate_quick *q, z_streamp strm, int flush) {
+  if (!q->window || (strm->avail_out == 0 && q->status != QUICK_DONE))
+    return Z_BUF_ERROR;
+  if (q->status == QUICK_HEADER)
+    quick_header(q, strm);
+  int progress = 0;
+  for (;;) {
+    unsigned n = q->pending_len - q->pending_out;
+    if (n > strm->avail_out)
+      n = strm->avail_out;
+    memcpy(strm->next_out, q->pending + q->pending_out, n);
+    strm->next_out += n;
+    strm->avail_out -= n;
+    strm->total_out += n;
+    q->pending_out += n;
+    progress |= n != 0;
+    if (q->pending_out < q->pending_len)
+      return Z_OK;
+    q->pending_out = q->pending_len = 0;
+    if (q->status == QUICK_DONE)
+      return Z_STREAM_END;
+    if (strm->avail_in && q->lookahead < q->chunk) {
+      quick_read(q, strm);
+      q->dirty = 1;
+      progress = 1;
+    } else if (q->lookahead == q->chunk ||
+               (q->lookahead && flush != Z_NO_FLUSH)) {
+      unsigned n = q->lookahead;
+      q->lookahead = 0;
+      if (q->opt)
+        optimal_chunk(q, strm, n);
+      else if (q->trees)
+        medium_chunk(q, strm, n);
+      else
+        quick_block(q, n);
+    } else if (flush == Z_FINISH) {
+      quick_trailer(q, strm);
+    } else if ((flush == Z_SYNC_FLUSH || flush == Z_FULL_FLUSH) && q->dirty) {
+      // empty stored block: the output so far can be decoded
+      put_bits(q, 0, 3);
+      align_bits(q);
+      out_byte(q, 0);
+      out_byte(q, 0);
+      out_byte(q, 0xff);
+      out_byte(q, 0xff);
+      q->dirty = 0;
+      if (flush == Z_FULL_FLUSH) {
+        q->base += 2 * q->wsize + 1; // move every position out of reach
+        q->hashed = q->fill;
+      }
+    } else {
+      return progress ? Z_OK : Z_BUF_ERROR;
+    }
+  }
+}
+
+int deflate_quick_flushed(const struct deflate_quick *q) {
+  return q->status == QUICK_RUN && !q->dirty &&
+         q->pending_out == q->pending_len;
+}
+
+unsigned deflate_quick_window(const struct deflate_quick *q,
+                              const unsigned char **window) {
+  unsigned size = q->fill < q->wsize ? q->fill : q->wsize;
+  *window = q->window + q->fill - size;
+  return size;
+}
+
+void deflate_quick_release(struct deflate_quick *q) {
+  my_zfree(Z_NULL, q->window);
+  my_zfree(Z_NULL, q->head);
+  my_zfree(Z_NULL, q->pending);
+  my_zfree(Z_NULL, q->prev);
+  trees_free(q->trees);
+  optimal_free(q->opt);
+  q->window = NULL;
+  q->head = NULL;
+  q->pending = NULL;
+  q->prev = NULL;
+  q->trees = NULL;
+  q->opt = NULL;
+}
+
+// The window ends where it did: its positions in the input are unchanged
+int deflate_quick_restore(struct deflate_quick *q, const unsigned char *window,
+                          unsigned size) {
+  q->base += q->fill - size;
+  q->fill = size;
+  q->lookahead = 0;
+  q->pending_len = q->pending_out = 0;
+  if (quick_alloc(q) != Z_OK)
+    return Z_MEM_ERROR;
+  memcpy(q->window, window, size);
+  struct match_chain mc = {q->window, q->base, q->head, q->prev, q->wsize - 1};
+  for (q->hashed = 0; q->hashed + QUICK_MIN_MATCH <= size; q->hashed++) {
+    unsigned h = match_hash4(q->window + q->hashed, q->hash_bits);
+    if (q->prev)
+      match_insert(&mc, q->hashed, h);
+    else
+      q->head[h] = q->base + q->hashed;
+  }
+  return Z_OK;
+}
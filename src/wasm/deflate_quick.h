@@ -0,0 +1,52 @@
+#ifndef DEFLATE_QUICK_H
+#define DEFLATE_QUICK_H
+
+#include <stddef.h>
+#include "zlib.h"
+
+// Deflate encoders used by the WASM_STRATEGY_QUICK and WASM_STRATEGY_MEDIUM
+// streams of deflate_stream_wasm.c instead of zlib's deflate. The output is a
+// regular zlib, gzip or raw deflate stream.
+//
+// Quick, the fastest: one hash probe per position, and literals and matches
+// written with the fixed Huffman codes as they are found, so that no tree is
+// built or sent. A block that the fixed codes make larger than its input is
+// stored instead.
+//
+// Medium, for levels 3 to 5: bounded hash chain searches (match_longest),
+// one lazy evaluation for short matches only, matches extended backwards
+// over the preceding literals, and blocks coded by trees.c.
+//
+// Optimal, for levels 10 to 12: the cheapest parse of each chunk of input
+// under a cost model refined over several passes, for data compressed once
+// and decompressed many times. Blocks are coded by trees.c.
+struct deflate_quick;
+
+// window_bits as for deflateInit2: negative for raw deflate, plus 16 for
+// gzip. level 3 to 5 selects medium, 10 to 12 optimal (higher ones are
+// clamped), and any other quick.
+struct deflate_quick *deflate_quick_new(int window_bits, int level);
+// The bytes deflate_quick_new allocates, for a memory budget
+size_t deflate_quick_cost(int window_bits, int level);
+// Free q, Z_DATA_ERROR if the stream was started and not finished, like
+// deflateEnd
+int deflate_quick_end(struct deflate_quick *q);
+
+// Compress like deflate(strm, flush): Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH
+// and Z_FINISH are supported, other values act as Z_NO_FLUSH. Input is
+// taken whole but coded a chunk at a time, so that the output does not
+// depend on the sizes of the calls; a partial chunk waits for a flush.
+int deflate_quick(struct deflate_quick *q, z_streamp strm, int flush);
+
+// Whether all the input is in the output, up to a sync or full flush point
+int deflate_quick_flushed(const struct deflate_quick *q);
+
+// Hibernation: the window bytes, which deflate_quick_release keeps as its
+// only state after freeing the buffers, and deflate_quick_restore gives back.
+unsigned deflate_quick_window(const struct deflate_quick *q,
+                              const unsigned char **window);
+void deflate_quick_release(struct deflate_quick *q);
+int deflate_quick_restore(struct deflate_quick *q, const unsigned char *window,
+                          unsigned size);
+
+#endif // DEFLATE_QUICK_H
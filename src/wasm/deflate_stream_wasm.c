@@ -2,8 +2,10 @@
 #include <string.h>
 #include <stdint.h>
 #include "zlib.h"
+#include "deflate.h"
 #include "allocator.h"
 #include "wasm_stream_common.h"
+#include "deflate_quick.h"
 
 #ifndef RAW_WBITS
 #if defined(MAX_WBITS)
@@ -13,55 +15,543 @@
 #endif
 #endif
 
+#define WASM_STRATEGY_AUTO (-1)
+#define WASM_STRATEGY_QUICK (Z_FIXED + 1)
+#define WASM_STRATEGY_MEDIUM (Z_FIXED + 2)
+
 struct wasm_deflate_ctx {
   WASM_STREAM_COMMON_FIELDS
+  int level;       /* deflateInit2 parameters, for deflate_wake */
+  int window_bits;
+  int mem_level;
+  int strategy;      /* current, base_strategy unless the controller steps */
+  int base_strategy; /* deflate_set_strategy, chosen on the first input */
+  struct deflate_quick *quick; /* QUICK and MEDIUM: replaces strm.state */
+  int flushed;     /* the last call flushed all the input and output */
+  int status;      /* deflate state kept by deflate_hibernate */
+  int wrap;
+  uLong adler;
+  uLong total_in;
+  uLong total_out;
+  int probe;       /* deflate_set_probe: store incompressible input */
+  int stored;      /* the probe switched the stream to level 0 */
+  int streak;      /* consecutive samples that looked random */
+  int gained;      /* matching pays on random looking input, or retry */
+  uLong retry;     /* stored input before matching a span again */
+  uLong span_in;   /* bytes consumed and produced in the current span */
+  uLong span_out;
+  uLong stored_in; /* bytes consumed at level 0 by the probe */
+  unsigned target; /* deflate_set_target: microseconds per MiB, or 0 */
+  int max_level;   /* the level given to deflate_init_params */
+  int rung;        /* steps taken below max_level by the controller */
+  int timed;       /* the last call consumed input at the current rung */
+  uLong ctl_in;    /* bytes consumed and time spent in the current span */
+  double ctl_us;
 };
 
-unsigned deflate_new(void) { return wasm_stream_new(); }
+unsigned deflate_new(void) {
+  return wasm_stream_new(sizeof(struct wasm_deflate_ctx), WASM_STREAM_DEFLATE);
+}
 
-int deflate_init(unsigned zptr, int level) {
+/* Strategy for the next deflate_init_params call, from Z_DEFAULT_STRATEGY to
+   Z_FIXED, WASM_STRATEGY_AUTO: the default until the first process call
+   chooses it from its input (see auto_strategy), WASM_STRATEGY_QUICK: the
+   fastest, which ignores the level, or WASM_STRATEGY_MEDIUM: levels 3 to 5
+   (others are clamped, the default is 5). Both use deflate_quick.c instead
+   of zlib and ignore mem_level. */
+int deflate_set_strategy(unsigned zptr, int strategy) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
+  if (!c || strategy < WASM_STRATEGY_AUTO || strategy > WASM_STRATEGY_MEDIUM)
+    return Z_STREAM_ERROR;
+  c->base_strategy = strategy;
+  return Z_OK;
+}
+
+/* The strategy set or chosen, WASM_STRATEGY_AUTO before the first input. */
+int deflate_strategy(unsigned zptr) {
   struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
-  if (level < 0)
-    level = Z_DEFAULT_COMPRESSION;
-  return deflateInit(&c->strm, level);
+  return c->base_strategy;
 }
 
-int deflate_init_raw(unsigned zptr, int level) {
+static int base_strategy(const struct wasm_deflate_ctx *c) {
+  return c->base_strategy == WASM_STRATEGY_AUTO ? Z_DEFAULT_STRATEGY
+                                                : c->base_strategy;
+}
+
+/* Initialize with deflateInit2's window_bits (negative for raw deflate, plus
+   16 for gzip) and mem_level, after reserving their memory from the budget
+   (Z_MEM_ERROR when exhausted, see wasm_stream_reserve). Levels 10 to 12 are
+   the optimal parser of deflate_quick.c, for any strategy but quick and
+   medium. */
+int deflate_init_params(unsigned zptr, int level, int window_bits,
+                        int mem_level) {
   struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
   if (level < 0)
     level = Z_DEFAULT_COMPRESSION;
-  return deflateInit2(&c->strm, level, Z_DEFLATED, -RAW_WBITS, 8,
-                      Z_DEFAULT_STRATEGY);
+  int strategy = base_strategy(c), quick = 0;
+  if (strategy == WASM_STRATEGY_QUICK)
+    quick = 1;
+  else if (strategy == WASM_STRATEGY_MEDIUM)
+    quick = level == Z_DEFAULT_COMPRESSION ? 5
+            : level < 3                    ? 3
+            : level > 5                    ? 5
+                                           : level;
+  else if (level >= 10 && level <= 12)
+    quick = level;
+  // deflate_quick.c's buffers are not zlib's: optimal takes about 1.5 MB
+  int r = quick ? wasm_stream_reserve_bytes(
+                      zptr, deflate_quick_cost(window_bits, quick))
+                : wasm_stream_reserve(zptr, window_bits, mem_level);
+  if (r != Z_OK)
+    return r;
+  c->level = level;
+  c->max_level = level == Z_DEFAULT_COMPRESSION ? 6 : level;
+  c->window_bits = window_bits;
+  c->mem_level = mem_level;
+  c->strategy = strategy;
+  if (quick) {
+    c->quick = deflate_quick_new(window_bits, quick);
+    return c->quick ? Z_OK : Z_MEM_ERROR;
+  }
+  return deflateInit2(&c->strm, level, Z_DEFLATED, window_bits, mem_level,
+                      c->strategy);
+}
+
+/* deflate_init_params with the smallest window_bits and mem_level that lose
+   nothing on expected_size bytes of input (0 if unknown): a window that
+   reaches back over all of it, and a symbol buffer (1 << (mem_level + 6))
+   that holds it in a single block, with a hash table twice that size.
+   window_bits gives the format and the largest window. */
+int deflate_init_sized(unsigned zptr, int level, int window_bits,
+                       unsigned expected_size) {
+  int max_bits = window_bits < 0 ? -window_bits : window_bits & 15;
+  int bits = max_bits, mem_level = 8;
+  if (expected_size) {
+    for (bits = 9; bits < max_bits; bits++)
+      if ((1UL << bits) - MIN_LOOKAHEAD >= expected_size)
+        break;
+    for (mem_level = 1; mem_level < 8; mem_level++)
+      if ((1UL << (mem_level + 6)) >= expected_size)
+        break;
+  }
+  if (window_bits < 0)
+    bits = -bits;
+  else if (window_bits > 15)
+    bits += 16;
+  return deflate_init_params(zptr, level, bits, mem_level);
+}
+
+int deflate_init(unsigned zptr, int level) {
+  return deflate_init_params(zptr, level, MAX_WBITS, 8);
+}
+
+int deflate_init_raw(unsigned zptr, int level) {
+  return deflate_init_params(zptr, level, -RAW_WBITS, 8);
 }
 
 int deflate_init_gzip(unsigned zptr, int level) {
+  return deflate_init_params(zptr, level, MAX_WBITS + 16, 8);
+}
+
+/* Switch the stream to stored blocks when its input looks incompressible
+   (deflate_set_probe), and back to its level when it no longer does. Two
+   signals are used: the byte distribution of a sample taken at the start of
+   each process call, and the output of the matcher over spans of input. */
+#define PROBE_SAMPLE 4096            /* sampled bytes per call, at most */
+#define PROBE_MIN_SAMPLE 1024        /* smaller inputs are not sampled */
+#define PROBE_STREAK 2               /* random samples before storing */
+#define PROBE_SPAN (1UL << 20)       /* input measured by the ratio */
+#define PROBE_RETRY (2 * PROBE_SPAN) /* stored input before a first retry */
+#define PROBE_MAX_RETRY (16UL << 20) /* and at most between retries */
+
+/* Whether the n bytes at p look random: the order-2 (collision) entropy of
+   their distribution, -log2(sum c(c-1) / n(n-1)), is above about 7.7 bits,
+   i.e. pairs of equal bytes are at most 5/4 of what uniform bytes give. Text
+   is around 5 bits, JPEG and MP4 payloads or compressed data close to 8. */
+static int probe_random(const unsigned char *p, unsigned n) {
+  unsigned count[256] = {0};
+  uint64_t pairs = 0; /* up to n^2 * 1024 below: past 32 bits on wasm32 */
+  for (unsigned i = 0; i < n; i++)
+    count[p[i]]++;
+  for (unsigned i = 0; i < 256; i++)
+    pairs += (uint64_t)count[i] * (count[i] - (count[i] != 0));
+  return pairs * 256 * 4 <= (uint64_t)n * (n - 1) * 5;
+}
+
+/* deflateParams with no input available, so that the pending input is not
+   compressed with the old parameters: the switch happens at a block boundary.
+   Z_BUF_ERROR if the output buffer is too small for that block. */
+static int deflate_switch(struct wasm_deflate_ctx *c, int level,
+                          int strategy) {
+  z_streamp strm = &c->strm;
+  uInt avail_in = strm->avail_in;
+  strm->avail_in = 0;
+  int r = deflateParams(strm, level, strategy);
+  strm->avail_in = avail_in;
+  return r;
+}
+
+// Does nothing if the switch fails, the next call tries again.
+static void probe_switch(struct wasm_deflate_ctx *c, int stored) {
+  if (deflate_switch(c, stored ? 0 : c->level, c->strategy) == Z_OK) {
+    c->stored = stored;
+    c->streak = 0;
+    if (stored && !c->retry)
+      c->retry = PROBE_RETRY;
+    c->span_in = c->span_out = 0;
+  }
+}
+
+static void probe_before(struct wasm_deflate_ctx *c) {
+  z_streamp strm = &c->strm;
+  if (strm->avail_in < PROBE_MIN_SAMPLE)
+    return;
+  int random = probe_random(strm->next_in, strm->avail_in < PROBE_SAMPLE
+                                               ? strm->avail_in
+                                               : PROBE_SAMPLE);
+  if (c->stored) {
+    if (!random || c->span_in >= c->retry) {
+      // a retry keeps matching for a whole span to measure it
+      c->gained = random;
+      if (!random)
+        c->retry = 0;
+      probe_switch(c, 0);
+    }
+    return;
+  }
+  c->streak = random ? c->streak + 1 : 0;
+  if (!random)
+    c->gained = 0;
+  if (c->streak >= PROBE_STREAK && !c->gained)
+    probe_switch(c, 1);
+}
+
+static void probe_after(struct wasm_deflate_ctx *c, uInt in, uInt out) {
+  c->span_in += in;
+  c->span_out += out;
+  if (c->stored) {
+    c->stored_in += in;
+    return;
+  }
+  if (c->span_in < PROBE_SPAN)
+    return;
+  // The output lags behind by up to a block: a span saving less than 1/32
+  // did not find matches, one of random looking samples saving 1/8 tells
+  // that they hide repetitions.
+  int none = c->span_out * 32 >= c->span_in * 31;
+  if (none && c->gained && c->retry < PROBE_MAX_RETRY)
+    c->retry *= 2; // a retry that did not pay, back off
+  c->gained = c->streak >= PROBE_STREAK && c->span_out * 8 < c->span_in * 7;
+  if (c->gained)
+    c->retry = 0;
+  c->span_in = c->span_out = 0;
+  if (none)
+    probe_switch(c, 1);
+}
+
+/* Enable (on != 0) or disable the probe. Disabling it restores the level at
+   the next process call. */
+int deflate_set_probe(unsigned zptr, int on) {
   struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
-  if (level < 0)
-    level = Z_DEFAULT_COMPRESSION;
-  return deflateInit2(&c->strm, level, Z_DEFLATED, MAX_WBITS + 16, 8,
-                      Z_DEFAULT_STRATEGY);
+  c->probe = on != 0;
+  return Z_OK;
+}
+
+/* Input bytes that the probe sent in stored blocks. */
+unsigned deflate_stored_bytes(unsigned zptr) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return 0;
+  return (unsigned)c->stored_in;
+}
+
+/* Throughput target: the caller reports the time spent in process calls
+   (deflate_account_time), and after each CTL_SPAN bytes of input the level
+   goes one step down when the span cost more than the target, or one step
+   back up toward max_level when it cost less than 2/3 of it. Below level 1,
+   the last step codes literals only (Z_HUFFMAN_ONLY). The new parameters
+   are set at the start of the next process call. */
+#define CTL_SPAN (256UL << 10)
+
+/* Aim at target microseconds per MiB of input (0: keep the level). */
+int deflate_set_target(unsigned zptr, unsigned target) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  c->target = target;
+  c->ctl_in = 0;
+  c->ctl_us = 0;
+  return Z_OK;
+}
+
+/* Add the time taken by the last process call, in microseconds. */
+int deflate_account_time(unsigned zptr, double us) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  if (!c->target || !c->timed)
+    return Z_OK;
+  c->ctl_us += us;
+  if (c->ctl_in < CTL_SPAN)
+    return Z_OK;
+  double cost = c->ctl_us * (1 << 20) / c->ctl_in;
+  if (cost > c->target && c->rung < c->max_level)
+    c->rung++;
+  else if (cost * 3 < c->target * 2.0 && c->rung > 0)
+    c->rung--;
+  c->ctl_in = 0;
+  c->ctl_us = 0;
+  return Z_OK;
+}
+
+static void ctl_apply(struct wasm_deflate_ctx *c) {
+  int level = c->max_level - c->rung, strategy = base_strategy(c);
+  if (level == 0) {
+    level = 1;
+    strategy = Z_HUFFMAN_ONLY;
+  }
+  if ((level != c->level || strategy != c->strategy) &&
+      deflate_switch(c, level, strategy) == Z_OK) {
+    c->level = level;
+    c->strategy = strategy;
+    c->ctl_in = 0;
+    c->ctl_us = 0;
+  }
+}
+
+/* Automatic strategy: the first process call compresses a sample of its
+   input with the default strategy, then with Z_HUFFMAN_ONLY and Z_RLE, the
+   fast ones, and keeps the smaller of these if its output is at most 1/16
+   larger. Fewer symbols are also faster to code: on sparse data Z_RLE beats
+   Z_HUFFMAN_ONLY on both. The byte histogram and runs of the sample skip
+   the trials that cannot win: text without runs, by the rule of
+   detect_data_type() in trees.c, needs matches, and Z_RLE only differs from
+   Z_HUFFMAN_ONLY on runs. */
+#define AUTO_SAMPLE 32768     /* sampled bytes, at most */
+#define AUTO_MIN_SAMPLE 1024  /* smaller first inputs keep the default */
+
+// size of the n bytes at p raw deflated by z with level and strategy
+static uLong auto_trial(z_streamp z, const unsigned char *p, unsigned n,
+                        int level, int strategy, unsigned char *out,
+                        uLong out_len) {
+  deflateReset(z);
+  deflateParams(z, level, strategy);
+  z->next_in = (unsigned char *)p;
+  z->avail_in = n;
+  z->next_out = out;
+  z->avail_out = (uInt)out_len;
+  if (deflate(z, Z_FINISH) != Z_STREAM_END)
+    return out_len;
+  return z->total_out;
+}
+
+static int auto_strategy(const struct wasm_deflate_ctx *c,
+                         const unsigned char *p, unsigned n) {
+  unsigned count[256] = {0}, runs = 0;
+  for (unsigned i = 0; i < n; i++) {
+    count[p[i]]++;
+    runs += i && p[i] == p[i - 1];
+  }
+  int text = count[9] || count[10] || count[13];
+  for (unsigned i = 32; i < 256 && !text; i++)
+    text = count[i] != 0;
+  for (unsigned i = 0, mask = 0xf3ffc07fU; i < 32; i++, mask >>= 1)
+    if ((mask & 1) && count[i])
+      text = 0;
+  if (n < AUTO_MIN_SAMPLE || c->level == 0 || (text && runs < n / 4))
+    return Z_DEFAULT_STRATEGY;
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  z.zalloc = my_zalloc;
+  z.zfree = my_zfree;
+  if (deflateInit2(&z, c->level, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return Z_DEFAULT_STRATEGY;
+  uLong out_len = deflateBound(&z, n);
+  unsigned char *out = (unsigned char *)malloc(out_len);
+  int strategy = Z_DEFAULT_STRATEGY;
+  if (out) {
+    uLong best = auto_trial(&z, p, n, c->level, Z_DEFAULT_STRATEGY, out,
+                            out_len);
+    uLong fast = auto_trial(&z, p, n, c->level, Z_HUFFMAN_ONLY, out, out_len);
+    int fast_strategy = Z_HUFFMAN_ONLY;
+    if (runs >= n / 16) {
+      uLong rle = auto_trial(&z, p, n, c->level, Z_RLE, out, out_len);
+      if (rle < fast) {
+        fast = rle;
+        fast_strategy = Z_RLE;
+      }
+    }
+    if (fast <= best + best / 16)
+      strategy = fast_strategy;
+    free(out);
+  }
+  deflateEnd(&z);
+  return strategy;
+}
+
+// deflate with the probe and the controller, noting whether the stream
+// stopped at a sync or full flush point
+static int deflate_tracked(z_streamp strm, int flush) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)strm;
+  int had_input = strm->avail_in != 0;
+  uInt avail_in = strm->avail_in, avail_out = strm->avail_out;
+  if (c->quick)
+    return deflate_quick(c->quick, strm, flush);
+  if (c->base_strategy == WASM_STRATEGY_AUTO && had_input) {
+    int strategy = auto_strategy(
+        c, strm->next_in,
+        strm->avail_in < AUTO_SAMPLE ? strm->avail_in : AUTO_SAMPLE);
+    if (deflate_switch(c, c->level, strategy) == Z_OK) {
+      c->base_strategy = strategy;
+      c->strategy = strategy;
+    }
+  }
+  if (c->stored && !c->probe)
+    probe_switch(c, 0);
+  if (c->target && c->max_level != 0 && !c->stored)
+    ctl_apply(c);
+  int probe = c->probe && c->level != 0;
+  if (probe)
+    probe_before(c);
+  int ret = deflate(strm, flush);
+  if (probe && ret == Z_OK)
+    probe_after(c, avail_in - strm->avail_in, avail_out - strm->avail_out);
+  // time spent storing or flushing says nothing about the level
+  c->timed = !c->stored && strm->avail_in != avail_in;
+  if (c->timed)
+    c->ctl_in += avail_in - strm->avail_in;
+  if (ret == Z_BUF_ERROR && !had_input)
+    return ret;
+  c->flushed = ret == Z_OK && strm->avail_out != 0 &&
+               (flush == Z_SYNC_FLUSH || flush == Z_FULL_FLUSH);
+  return ret;
 }
 
 int deflate_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
                     unsigned out_ptr, unsigned out_len, int flush) {
   return wasm_stream_process_common(zptr, in_ptr, in_len, out_ptr, out_len,
-                                    flush, deflate);
+                                    flush, deflate_tracked);
 }
 
-int deflate_end(unsigned zptr) {
+/* Quick and medium streams keep their state but the window, hash tables and
+   buffers. */
+static int quick_wake(struct wasm_stream_ctx *sc) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)sc;
+  unsigned size = c->hib->size;
+  unsigned char *window = (unsigned char *)malloc(size + 1);
+  if (!window)
+    return Z_MEM_ERROR;
+  int r = wasm_stream_restore(sc, window);
+  if (r == Z_OK)
+    r = deflate_quick_restore(c->quick, window, size);
+  free(window);
+  return r;
+}
+
+static int quick_hibernate(struct wasm_deflate_ctx *c) {
+  if (c->hib)
+    return Z_OK;
+  if (!deflate_quick_flushed(c->quick))
+    return Z_BUF_ERROR;
+  const unsigned char *window;
+  unsigned size = deflate_quick_window(c->quick, &window);
+  int r = wasm_stream_hibernate((struct wasm_stream_ctx *)c, window, size,
+                                window + size, 0, quick_wake);
+  if (r != Z_OK)
+    return r;
+  deflate_quick_release(c->quick);
+  return Z_OK;
+}
+
+/* Rebuild the stream freed by deflate_hibernate: a raw stream primed with the
+   kept window, then the wrapper state so that the header is not written
+   again and the trailer covers all the input. */
+static int deflate_wake(struct wasm_stream_ctx *sc) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)sc;
+  unsigned size = c->hib->size;
+  int bits = c->window_bits < 0 ? -c->window_bits : c->window_bits & 15;
+  if (bits == 8)
+    bits = 9; /* as deflateInit2 did, raw streams refuse 8 */
+  unsigned char *dict = (unsigned char *)malloc(size + 1);
+  if (!dict)
+    return Z_MEM_ERROR;
+  int r = deflateInit2(&c->strm, c->stored ? 0 : c->level, Z_DEFLATED, -bits,
+                       c->mem_level, c->strategy);
+  if (r == Z_OK)
+    r = wasm_stream_restore(sc, dict);
+  if (r == Z_OK && size)
+    r = deflateSetDictionary(&c->strm, dict, size);
+  free(dict);
+  if (r != Z_OK)
+    return r;
+  deflate_state *s = (deflate_state *)c->strm.state;
+  s->status = c->status;
+  s->wrap = c->wrap;
+  c->strm.adler = c->adler;
+  c->strm.total_in = c->total_in;
+  c->strm.total_out = c->total_out;
+  return Z_OK;
+}
+
+/* Free the deflate state (window, hash chains, pending buffer) until the next
+   process call, keeping only the window bytes. Only possible right after a
+   Z_SYNC_FLUSH or Z_FULL_FLUSH that delivered all the output: Z_BUF_ERROR
+   otherwise. */
+int deflate_hibernate(unsigned zptr) {
   struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
-  if (!c)
+  if (c && c->quick)
+    return quick_hibernate(c);
+  if (!c || (c->strm.state == Z_NULL && !c->hib))
     return Z_STREAM_ERROR;
-  int r = deflateEnd(&c->strm);
-  free(c->inbuf);
-  free(c);
-  return r;
+  if (c->hib)
+    return Z_OK;
+  unsigned pending;
+  int bits;
+  if (!c->flushed || deflatePending(&c->strm, &pending, &bits) != Z_OK ||
+      pending || bits)
+    return Z_BUF_ERROR;
+  deflate_state *s = (deflate_state *)c->strm.state;
+  uInt len = 0;
+  unsigned char *dict = (unsigned char *)malloc(1U << MAX_WBITS);
+  if (!dict)
+    return Z_MEM_ERROR;
+  int r = deflateGetDictionary(&c->strm, dict, &len);
+  if (r == Z_OK)
+    r = wasm_stream_hibernate((struct wasm_stream_ctx *)c, dict, len,
+                              dict + len, 0, deflate_wake);
+  free(dict);
+  if (r != Z_OK)
+    return r;
+  c->status = s->status;
+  c->wrap = s->wrap;
+  c->adler = c->strm.adler;
+  c->total_in = c->strm.total_in;
+  c->total_out = c->strm.total_out;
+  c->flushed = 0;
+  deflateEnd(&c->strm);
+  return Z_OK;
+}
+
+static int quick_end(z_streamp strm) {
+  return deflate_quick_end(((struct wasm_deflate_ctx *)strm)->quick);
+}
+
+int deflate_end(unsigned zptr) {
+  struct wasm_deflate_ctx *c = (struct wasm_deflate_ctx *)(uintptr_t)zptr;
+  if (c && c->quick && c->hib) {
+    // wasm_stream_end does not call end_func on hibernated deflate streams
+    deflate_quick_end(c->quick);
+    c->quick = NULL;
+  }
+  return wasm_stream_end(zptr, c && c->quick ? quick_end : deflateEnd);
 }
 
 unsigned deflate_last_consumed(unsigned zptr) {
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdint.h>
 #include "zlib.h"
+#include "infstats.h"
 #include "wasm_stream_common.h"
 
 #define DEFLATE64_WBITS 16
@@ -10,12 +11,18 @@ struct wasm_inflate9_ctx {
   WASM_STREAM_COMMON_FIELDS;
 };
 
-unsigned inflate9_new(void) { return wasm_stream_new(); }
+unsigned inflate9_new(void) {
+  return wasm_stream_new(sizeof(struct wasm_inflate9_ctx),
+                         WASM_STREAM_INFLATE9);
+}
 
 int inflate9_init_raw(unsigned zptr) {
   struct wasm_inflate9_ctx *c = (struct wasm_inflate9_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
+  int r = wasm_stream_reserve(zptr, DEFLATE64_WBITS, 0);
+  if (r != Z_OK)
+    return r;
   return inflateInit2(&c->strm, -DEFLATE64_WBITS);
 }
 
@@ -32,3 +39,34 @@ int inflate9_end(unsigned zptr) { return wasm_stream_end(zptr, inflateEnd); }
 unsigned inflate9_last_consumed(unsigned zptr) {
   return wasm_stream_last_consumed(zptr);
 }
+
+/* Free the window until the next process call, see wasm_inflate_hibernate */
+int inflate9_hibernate(unsigned zptr) { return wasm_inflate_hibernate(zptr); }
+
+/* Output ring mode, see wasm_inflate_ring: returns the address of the ring,
+   which inflate9_ring_process writes to, or 0 */
+unsigned inflate9_ring(unsigned zptr, unsigned size) {
+  return wasm_inflate_ring(zptr, size);
+}
+
+int inflate9_ring_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
+                          int flush) {
+  return wasm_inflate_ring_process(zptr, in_ptr, in_len, flush, inflate);
+}
+
+unsigned inflate9_ring_out(unsigned zptr) {
+  return wasm_inflate_ring_out(zptr);
+}
+
+/* Decode the whole output to the caller's buffer, with inflate9_ring_process,
+   see wasm_inflate_back */
+int inflate9_back(unsigned zptr, unsigned out_ptr, unsigned out_len) {
+  return wasm_inflate_back(zptr, out_ptr, out_len);
+}
+
+int inflate9_stats(unsigned zptr, unsigned out_ptr) {
+  struct wasm_inflate9_ctx *c = (struct wasm_inflate9_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  return inflateGetStats(&c->strm, (inf_stats *)(uintptr_t)out_ptr);
+}
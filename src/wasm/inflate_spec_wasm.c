@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "zutil.h"
+#include "inftrees.h"
+#include "infspec.h"
+#include "allocator.h"
+
+// first size of the symbol buffer, doubled when a block does not fit
+#define SPEC_OUT_SIZE (1UL << 18)
+
+struct wasm_spec_ctx {
+  spec_state s;
+};
+
+unsigned inflate_spec_new(void) {
+  struct wasm_spec_ctx *c =
+      (struct wasm_spec_ctx *)calloc(1, sizeof(struct wasm_spec_ctx));
+  if (c)
+    wasm_alloc_account((long)sizeof(struct wasm_spec_ctx));
+  return (unsigned)(uintptr_t)c;
+}
+
+/* Decode in_len bytes of raw deflate data from the block at bit from_bit, or
+   when search_bits is not zero, from the first block found below from_bit +
+   search_bits (see inflate_spec_find). Decoding stops after the final block
+   or before the first block at or after stop_bit. Matches may reach wsize
+   bytes before the output, which yields markers: 0 at the start of a stream,
+   32768 otherwise. */
+int inflate_spec_decode(unsigned zptr, unsigned in_ptr, unsigned in_len,
+                        unsigned from_bit, unsigned search_bits,
+                        unsigned stop_bit, unsigned wsize) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  if (!c || wsize > SPEC_WSIZE)
+    return Z_STREAM_ERROR;
+  spec_state *s = &c->s;
+  s->in = (const unsigned char *)(uintptr_t)in_ptr;
+  s->len = in_len;
+  s->start = s->pos = from_bit;
+  s->have = s->markers = 0;
+  s->wsize = wsize;
+  s->last = 0;
+  int found = search_bits == 0;
+  for (;;) {
+    int ret = Z_OK;
+    s->full = 0;
+    if (!found) {
+      ret = inflate_spec_find(s, (unsigned long)from_bit + search_bits);
+      found = ret == Z_OK;
+    }
+    if (found)
+      ret = inflate_spec_blocks(s, stop_bit);
+    if (ret != Z_BUF_ERROR || !s->full)
+      return ret;
+    unsigned long size = s->size ? s->size * 2 : SPEC_OUT_SIZE;
+    unsigned short *out =
+        (unsigned short *)realloc(s->out, size * sizeof(unsigned short));
+    if (!out)
+      return Z_MEM_ERROR;
+    wasm_alloc_account((long)((size - s->size) * sizeof(unsigned short)));
+    s->out = out;
+    s->size = size;
+  }
+}
+
+unsigned inflate_spec_start(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? (unsigned)c->s.start : 0;
+}
+
+unsigned inflate_spec_stop(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? (unsigned)c->s.pos : 0;
+}
+
+int inflate_spec_last(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? c->s.last : 0;
+}
+
+unsigned inflate_spec_symbols(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? (unsigned)(uintptr_t)c->s.out : 0;
+}
+
+unsigned inflate_spec_count(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? (unsigned)c->s.have : 0;
+}
+
+unsigned inflate_spec_markers(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  return c ? (unsigned)c->s.markers : 0;
+}
+
+int inflate_spec_end(unsigned zptr) {
+  struct wasm_spec_ctx *c = (struct wasm_spec_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  wasm_alloc_account(-(long)(sizeof(struct wasm_spec_ctx) +
+                              c->s.size * sizeof(unsigned short)));
+  free(c->s.out);
+  free(c);
+  return Z_OK;
+}
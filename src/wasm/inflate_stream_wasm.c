@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdint.h>
 #include "zlib.h"
+#include "infstats.h"
 #include "allocator.h"
 #include "wasm_stream_common.h"
 
@@ -15,14 +16,45 @@
 
 struct wasm_inflate_ctx {
   WASM_STREAM_COMMON_FIELDS
+  int gzip;         /* true when decoding (possibly concatenated) gzip */
+  int member_end;   /* a gzip member ended, reset on the next member */
+  unsigned members; /* number of gzip members decoded so far */
 };
 
-unsigned inflate_new(void) { return wasm_stream_new(); }
+unsigned inflate_new(void) {
+  return wasm_stream_new(sizeof(struct wasm_inflate_ctx), WASM_STREAM_INFLATE);
+}
+
+/* Decode concatenated gzip members (RFC 1952, section 2.2). A call stops at
+   the end of a member so that the caller sees each boundary; the next call
+   resets the stream and resumes on the leftover input if it starts with the
+   gzip magic. Anything else after a member is left unconsumed. */
+static int inflate_gzip_members(z_streamp strm, int flush) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)strm;
+  if (c->member_end) {
+    if (strm->avail_in == 0 || strm->next_in[0] != 0x1f ||
+        (strm->avail_in > 1 && strm->next_in[1] != 0x8b))
+      return Z_STREAM_END;
+    int r = inflateReset(strm);
+    if (r != Z_OK)
+      return r;
+    c->member_end = 0;
+  }
+  int ret = inflate(strm, flush);
+  if (ret == Z_STREAM_END) {
+    c->member_end = 1;
+    c->members++;
+  }
+  return ret;
+}
 
 int inflate_init(unsigned zptr) {
   struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
+  int r = wasm_stream_reserve(zptr, MAX_WBITS, 0);
+  if (r != Z_OK)
+    return r;
   return inflateInit(&c->strm);
 }
 
@@ -30,6 +62,9 @@ int inflate_init_raw(unsigned zptr) {
   struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
+  int r = wasm_stream_reserve(zptr, RAW_WBITS, 0);
+  if (r != Z_OK)
+    return r;
   return inflateInit2(&c->strm, -RAW_WBITS);
 }
 
@@ -37,6 +72,10 @@ int inflate_init_gzip(unsigned zptr) {
   struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
+  int r = wasm_stream_reserve(zptr, MAX_WBITS, 0);
+  if (r != Z_OK)
+    return r;
+  c->gzip = 1;
 #if defined(MAX_WBITS)
   return inflateInit2(&c->strm, MAX_WBITS + 16);
 #else
@@ -46,8 +85,11 @@ int inflate_init_gzip(unsigned zptr) {
 
 int inflate_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
                     unsigned out_ptr, unsigned out_len, int flush) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
   return wasm_stream_process_common(zptr, in_ptr, in_len, out_ptr, out_len,
-                                    flush, inflate);
+                                    flush,
+                                    c && c->gzip ? inflate_gzip_members
+                                                 : inflate);
 }
 
 int inflate_end(unsigned zptr) { return wasm_stream_end(zptr, inflateEnd); }
@@ -55,3 +97,62 @@ int inflate_end(unsigned zptr) { return wasm_stream_end(zptr, inflateEnd); }
 unsigned inflate_last_consumed(unsigned zptr) {
   return wasm_stream_last_consumed(zptr);
 }
+
+/* Free the window until the next process call, see wasm_inflate_hibernate */
+int inflate_hibernate(unsigned zptr) { return wasm_inflate_hibernate(zptr); }
+
+/* Output ring mode, see wasm_inflate_ring: returns the address of the ring,
+   which inflate_ring_process writes to, or 0 */
+unsigned inflate_ring(unsigned zptr, unsigned size) {
+  return wasm_inflate_ring(zptr, size);
+}
+
+int inflate_ring_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
+                         int flush) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
+  return wasm_inflate_ring_process(zptr, in_ptr, in_len, flush,
+                                   c && c->gzip ? inflate_gzip_members
+                                                : inflate);
+}
+
+unsigned inflate_ring_out(unsigned zptr) { return wasm_inflate_ring_out(zptr); }
+
+/* Decode the whole output to the caller's buffer, with inflate_ring_process,
+   see wasm_inflate_back */
+int inflate_back(unsigned zptr, unsigned out_ptr, unsigned out_len) {
+  return wasm_inflate_back(zptr, out_ptr, out_len);
+}
+
+int inflate_set_dictionary(unsigned zptr, unsigned dict_ptr,
+                           unsigned dict_len) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  return inflateSetDictionary(
+      &c->strm, (const Bytef *)(uintptr_t)dict_ptr, dict_len);
+}
+
+/* strm.data_type after the last call: the number of unused bits, plus 64 if
+   in the last block and 128 if stopped at a block boundary (see zlib.h). */
+unsigned inflate_data_type(unsigned zptr) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return 0;
+  return (unsigned)c->strm.data_type;
+}
+
+/* Copy the counters of the stream (struct inf_stats in infstats.h, an array
+   of unsigned) to out_ptr. Fails unless built with -DINFLATE_STATS. */
+int inflate_stats(unsigned zptr, unsigned out_ptr) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  return inflateGetStats(&c->strm, (inf_stats *)(uintptr_t)out_ptr);
+}
+
+unsigned inflate_members(unsigned zptr) {
+  struct wasm_inflate_ctx *c = (struct wasm_inflate_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return 0;
+  return c->members;
+}
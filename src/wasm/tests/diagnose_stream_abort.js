@@ -0,0 +1,108 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import { randomFillSync } from 'crypto';
+
+// Usage: node --expose-gc diagnose_stream_abort.js [wasm] [--iterations=N] [--packet=bytes] [--seed=N] [--shared]
+// Aborts, cancels or abandons compression/decompression pipelines at random
+// points, then checks that the WASM heap returns to its baseline.
+const wasmPath = process.argv[2] && !process.argv[2].startsWith('--') ? process.argv[2] : join('dist','zlib-streams-dev.wasm');
+let ITER = 500;
+let PACKET = 16 * 1024;
+let SEED = 1;
+let SHARED = false;
+for (const a of process.argv.slice(2)) {
+  if (a.startsWith('--iterations=')) ITER = Number(a.split('=')[1]);
+  if (a.startsWith('--packet=')) PACKET = Number(a.split('=')[1]);
+  if (a.startsWith('--seed=')) SEED = Number(a.split('=')[1]);
+  if (a === '--shared') SHARED = true;
+}
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+let seed = SEED;
+const random = (n) => { seed = (seed * 1103515245 + 12345) >>> 0; return (seed >>> 16) % n; };
+const MODES = ['complete', 'abort', 'cancel', 'abandon'];
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  // bytes in use in malloc, which also counts the buffers malloc'ed from JS
+  const sample = () => {
+    const s = getWasmStats();
+    return { live: s.liveBytes, used: s.heapBytes - s.freeBytes, contexts: s.inflateContexts + s.inflate9Contexts + s.deflateContexts, memory: s.memoryBytes };
+  };
+  const collect = async () => {
+    // finalization callbacks run after the collection, in a later task
+    for (let i = 0; i < 10 && typeof global.gc === 'function'; i++) {
+      global.gc();
+      await new Promise(resolve => setTimeout(resolve, 10));
+    }
+  };
+
+  const src = Buffer.allocUnsafe(PACKET);
+  randomFillSync(src);
+  for (let i = 0; i < src.length; i += 2) src[i] = 0x41;
+  const types = ['deflate', 'deflate-raw', 'gzip'];
+
+  async function run(mode, type, packets, stopAt) {
+    const pump = new TransformStream();
+    const writer = pump.writable.getWriter();
+    const cs = new CompressionStreamZlib(type, { sharedBuffers: SHARED });
+    const ds = new DecompressionStreamZlib(type, { sharedBuffers: SHARED });
+    const reader = pump.readable.pipeThrough(cs).pipeThrough(ds).getReader();
+    const readTask = (async () => {
+      try {
+        for (let n = 0; ; n++) {
+          if (mode === 'cancel' && n === stopAt) {
+            await reader.cancel(new Error('canceled'));
+            break;
+          }
+          const { done } = await reader.read();
+          if (done) break;
+        }
+      } catch (e) {
+        // aborted
+      }
+    })();
+    for (let n = 0; n < packets; n++) {
+      if (n === stopAt && mode === 'abort') {
+        await writer.abort(new Error('aborted')).catch(() => {});
+        break;
+      }
+      // abandon: drop the pipeline, left to the FinalizationRegistry
+      if (n === stopAt && mode === 'abandon') return;
+      try { await writer.write(src); } catch (e) { break; }
+    }
+    await writer.close().catch(() => {});
+    await readTask;
+  }
+
+  console.log('diagnose_stream_abort: iterations=%d packet=%d seed=%d shared=%s wasm=%s gc=%s', ITER, PACKET, SEED, SHARED, wasmPath, typeof global.gc === 'function');
+  await run('complete', 'gzip', 2, 0);
+  await collect();
+  const base = sample();
+  const counts = {};
+  for (let i = 1; i <= ITER; i++) {
+    const mode = MODES[random(MODES.length)];
+    counts[mode] = (counts[mode] || 0) + 1;
+    await run(mode, types[random(types.length)], 1 + random(8), random(8));
+    if (i % 100 === 0 || i === ITER) {
+      await collect();
+      const s = sample();
+      console.log('iter=%d live=%d (base %d) used=%d (base %d) contexts=%d wasm_mem=%dMB', i, s.live, base.live, s.used, base.used, s.contexts, Math.round(s.memory / (1024*1024)));
+    }
+  }
+  await collect();
+  const end = sample();
+  console.log('modes: %j', counts);
+  if (end.live !== base.live || end.contexts !== base.contexts || end.used !== base.used) {
+    if (typeof global.gc !== 'function') console.error('run with node --expose-gc: abandoned streams are released on collection');
+    console.error('ABORT STRESS FAILED: %j, baseline %j', end, base);
+    process.exit(3);
+  }
+  console.log('ABORT STRESS OK');
+  process.exit(0);
+})();
@@ -20,7 +20,7 @@ if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process
   const exp = instance.exports;
 
   const mod = await import('../api/zlib-streams.js');
-    const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports } = mod;
+    const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
   setWasmExports(exp);
 
   function statsLine(iter) {
@@ -29,6 +29,7 @@ if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process
       wasm_mem_bytes: exp.memory.buffer.byteLength,
       rss: process.memoryUsage().rss,
       arrayBuffers: process.memoryUsage().arrayBuffers,
+      wasm_stats: getWasmStats(),
     };
   }
 
@@ -0,0 +1,83 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_incompressible.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('INCOMPRESSIBLE FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(data, options) {
+    let stats;
+    const cs = new CompressionStreamZlib('gzip', { ...options, onStats: (s) => { stats = s; } });
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    for (let offset = 0; offset < data.length; offset += 65536) {
+      await writer.write(data.subarray(offset, offset + 65536));
+    }
+    await writer.close();
+    await readerTask;
+    return { data: Buffer.concat(chunks), storedBytes: stats.storedBytes };
+  }
+
+  // random runs (media payloads) between text runs, then random data that
+  // repeats within the window: high entropy but compressible
+  const random = (length, seed) => {
+    const buffer = Buffer.alloc(length);
+    for (let i = 0, x = seed; i < length; i++) { x = (Math.imul(x, 1103515245) + 12345) >>> 0; buffer[i] = x >>> 24; }
+    return buffer;
+  };
+  let text = '';
+  for (let i = 0; text.length < 2000000; i++) text += `record ${i % 977} value ${(i * 7919) % 10007} status ${i % 3 ? 'ok' : 'retry'}\n`;
+  const textBuffer = Buffer.from(text);
+  const mixed = Buffer.concat([random(3000000, 1), textBuffer, random(3000000, 2), textBuffer]);
+  const repeated = Buffer.concat(Array.from({ length: 400 }, () => random(16384, 3)));
+  // half zero bytes: one byte value fills half of each sample
+  const skewed = Buffer.concat(Array.from({ length: 1000 }, (_, i) => Buffer.concat([Buffer.alloc(2048), random(2048, i + 4)])));
+
+  for (const level of [1, 6, 9]) {
+    const plain = await compress(mixed, { level });
+    const probed = await compress(mixed, { level, skipIncompressible: true });
+    if (Buffer.compare(zlib.gunzipSync(probed.data), mixed) !== 0) fail(`level ${level}: round trip`);
+    if (plain.storedBytes !== 0) fail(`level ${level}: ${plain.storedBytes} bytes stored without the option`);
+    if (probed.storedBytes < 3500000 || probed.storedBytes > 6000000) fail(`level ${level}: ${probed.storedBytes} bytes stored`);
+    if (probed.data.length > plain.data.length * 1.001) fail(`level ${level}: ${probed.data.length} bytes, ${plain.data.length} without the probe`);
+
+    const repeatedPlain = await compress(repeated, { level });
+    const repeatedProbed = await compress(repeated, { level, skipIncompressible: true });
+    if (Buffer.compare(zlib.gunzipSync(repeatedProbed.data), repeated) !== 0) fail(`level ${level}: repeated round trip`);
+    if (repeatedProbed.data.length > repeatedPlain.data.length + 2.25 * 1024 * 1024) fail(`level ${level}: repeated data ${repeatedProbed.data.length} bytes, ${repeatedPlain.data.length} without the probe`);
+
+    const skewedPlain = await compress(skewed, { level });
+    const skewedProbed = await compress(skewed, { level, skipIncompressible: true });
+    if (Buffer.compare(zlib.gunzipSync(skewedProbed.data), skewed) !== 0) fail(`level ${level}: skewed round trip`);
+    if (skewedProbed.storedBytes !== 0) fail(`level ${level}: ${skewedProbed.storedBytes} bytes of skewed data stored`);
+    if (skewedProbed.data.length > skewedPlain.data.length * 1.001) fail(`level ${level}: skewed data ${skewedProbed.data.length} bytes, ${skewedPlain.data.length} without the probe`);
+  }
+  const stored = await compress(mixed, { level: 0, skipIncompressible: true });
+  if (Buffer.compare(zlib.gunzipSync(stored.data), mixed) !== 0 || stored.storedBytes !== 0) fail('level 0');
+  console.log('INCOMPRESSIBLE OK');
+  process.exit(0);
+})();
@@ -0,0 +1,74 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_optimal.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('OPTIMAL FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(type, data, options, chunkSize = 10000, hibernate = false) {
+    const cs = new CompressionStreamZlib(type, options);
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    for (let offset = 0; offset < data.length; offset += chunkSize) {
+      await writer.write(data.subarray(offset, offset + chunkSize));
+      if (hibernate) cs.hibernate();
+    }
+    await writer.close();
+    await readerTask;
+    return Buffer.concat(chunks);
+  }
+
+  // text, then sparse binary: levels 10 to 12 beat zlib's level 9 on both
+  let text = '';
+  for (let i = 0; text.length < 150000; i++) text += `<li id="item-${i % 613}" class="${i % 7 ? 'entry' : 'entry new'}">value ${(i * 7919) % 10007}</li>\n`;
+  const sparse = Buffer.alloc(100000);
+  for (let i = 0, x = 1; i < sparse.length; i++) {
+    x = (Math.imul(x, 1103515245) + 12345) >>> 0;
+    sparse[i] = (x >>> 24) < 16 ? (x >>> 16) & 0xff : 0;
+  }
+  const input = Buffer.concat([Buffer.from(text), sparse]);
+  const unzip = { 'gzip': zlib.gunzipSync, 'deflate': zlib.inflateSync, 'deflate-raw': zlib.inflateRawSync };
+  const level9 = zlib.deflateRawSync(input, { level: 9 }).length;
+  for (const level of [10, 11, 12]) {
+    for (const type of Object.keys(unzip)) {
+      const data = await compress(type, input, { level });
+      if (Buffer.compare(unzip[type](data), input) !== 0) fail(`level ${level} ${type}: round trip`);
+      if (type === 'deflate-raw' && data.length >= level9) fail(`level ${level}: ${data.length} bytes, ${level9} at level 9`);
+    }
+    // small writes: still whole chunks, the same output
+    const whole = await compress('deflate-raw', input, { level }, input.length);
+    for (const chunkSize of [100, 1000]) {
+      const small = await compress('deflate-raw', input, { level }, chunkSize);
+      if (Buffer.compare(small, whole) !== 0) fail(`level ${level}: ${small.length} bytes in writes of ${chunkSize}, ${whole.length} in one`);
+    }
+  }
+  // flush points and hibernation between the writes
+  const data = await compress('deflate', input, { level: 10, outBuffer: 1000 }, 10000, true);
+  if (Buffer.compare(zlib.inflateSync(data), input) !== 0) fail('hibernate: round trip');
+  console.log('OPTIMAL OK');
+  process.exit(0);
+})();
@@ -0,0 +1,57 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_sized.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('SIZED FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(type, data, options) {
+    const cs = new CompressionStreamZlib(type, options);
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const reserved = getWasmStats().reservedBytes;
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    await writer.write(data);
+    await writer.close();
+    await readerTask;
+    return { data: Buffer.concat(chunks), reserved };
+  }
+
+  const json = JSON.stringify(Array.from({ length: 3000 }, (_, i) => ({ id: i, name: `item-${i % 97}`, tags: ['a', 'b', 'c'].slice(i % 3) })));
+  const unzip = { 'gzip': zlib.gunzipSync, 'deflate': zlib.inflateSync, 'deflate-raw': zlib.inflateRawSync };
+  for (const size of [150, 2000, 30000, json.length]) {
+    const input = Buffer.from(json.slice(0, size));
+    for (const type of ['gzip', 'deflate', 'deflate-raw']) {
+      const fixed = await compress(type, input, {});
+      const sized = await compress(type, input, { expectedSize: input.length });
+      if (Buffer.compare(unzip[type](sized.data), input) !== 0) fail(`${type} ${size}: round trip`);
+      if (sized.data.length > fixed.data.length * 1.01 + 4) fail(`${type} ${size}: ${sized.data.length} bytes, ${fixed.data.length} with the default parameters`);
+      if (sized.reserved > fixed.reserved || (size <= 2000 && sized.reserved * 4 > fixed.reserved)) fail(`${type} ${size}: reserved ${sized.reserved}, ${fixed.reserved} with the default parameters`);
+    }
+  }
+  console.log('SIZED OK');
+  process.exit(0);
+})();
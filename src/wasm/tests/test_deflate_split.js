@@ -0,0 +1,83 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_split.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('SPLIT FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(data, options) {
+    const cs = new CompressionStreamZlib('deflate-raw', options);
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    for (let offset = 0; offset < data.length; offset += 65536) {
+      await writer.write(data.subarray(offset, offset + 65536));
+    }
+    await writer.close();
+    await readerTask;
+    return Buffer.concat(chunks);
+  }
+
+  // archive-like data: text files between binary ones of other statistics,
+  // several of each per block of symbols
+  let x = 1;
+  const next = () => (x = (Math.imul(x, 1103515245) + 12345) >>> 0) >>> 16;
+  const parts = [];
+  let plain = '';
+  for (let file = 0; parts.length < 400; file++) {
+    let text = '';
+    for (let i = 0; text.length < 4000 + next() % 8000; i++) text += `${['name', 'value', 'status', 'owner'][next() % 4]}: ${next() % 1000} ${i % 7 ? 'ok' : 'retry'}\n`;
+    parts.push(Buffer.from(text));
+    plain += text;
+    const binary = Buffer.alloc(4000 + next() % 8000);
+    for (let i = 0; i < binary.length; i++) binary[i] = 112 + (next() >> 11);
+    parts.push(binary);
+  }
+  const mixed = Buffer.concat(parts);
+  const text = Buffer.from(plain);
+
+  // zlib ends blocks when its symbol buffer is full only. Its matches
+  // depend on the build (node's zlib has another matcher), so the sizes are
+  // compared with Huffman coding only, which is the same in every zlib
+  for (const level of [1, 6, 9]) {
+    const data = await compress(mixed, { level });
+    if (Buffer.compare(zlib.inflateRawSync(data), mixed) !== 0) fail(`level ${level}: round trip`);
+    const textData = await compress(text, { level });
+    if (Buffer.compare(zlib.inflateRawSync(textData), text) !== 0) fail(`level ${level}: text round trip`);
+  }
+  const huffmanOnly = { strategy: zlib.constants.Z_HUFFMAN_ONLY };
+  const data = await compress(mixed, { strategy: 'huffman-only' });
+  if (Buffer.compare(zlib.inflateRawSync(data), mixed) !== 0) fail('huffman-only: round trip');
+  const reference = zlib.deflateRawSync(mixed, huffmanOnly).length;
+  if (data.length > reference * 0.99) fail(`huffman-only: ${data.length} bytes, ${reference} without splitting`);
+
+  const textData = await compress(text, { strategy: 'huffman-only' });
+  if (Buffer.compare(zlib.inflateRawSync(textData), text) !== 0) fail('huffman-only: text round trip');
+  const textReference = zlib.deflateRawSync(text, huffmanOnly).length;
+  if (textData.length > textReference * 1.01) fail(`huffman-only: text ${textData.length} bytes, ${textReference} without splitting`);
+  console.log('SPLIT OK');
+  process.exit(0);
+})();
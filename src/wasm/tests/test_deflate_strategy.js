@@ -0,0 +1,122 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_strategy.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('STRATEGY FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(data, options, chunkSize = 65536) {
+    let stats;
+    const cs = new CompressionStreamZlib('deflate-raw', { ...options, onStats: (s) => { stats = s; } });
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    for (let offset = 0; offset < data.length; offset += chunkSize) {
+      await writer.write(data.subarray(offset, offset + chunkSize));
+    }
+    await writer.close();
+    await readerTask;
+    return { data: Buffer.concat(chunks), strategy: stats.strategy };
+  }
+
+  let text = '';
+  for (let i = 0; text.length < 1000000; i++) text += `record ${i % 977} value ${(i * 7919) % 10007} status ${i % 3 ? 'ok' : 'retry'}\n`;
+  const random = Buffer.alloc(1000000);
+  const sparse = Buffer.alloc(1000000);
+  for (let i = 0, x = 1; i < random.length; i++) {
+    x = (Math.imul(x, 1103515245) + 12345) >>> 0;
+    random[i] = x >>> 24;
+    sparse[i] = random[i] < 16 ? (x >>> 16) & 0xff : 0;
+  }
+  // auto: the fastest strategy within 1/16 of the default on the first input
+  const inputs = { text: [Buffer.from(text), 'default'], random: [random, 'huffman-only'], sparse: [sparse, 'rle'] };
+  for (const [name, [input, expected]] of Object.entries(inputs)) {
+    for (const level of [1, 6, 9]) {
+      const auto = await compress(input, { level, strategy: 'auto' });
+      if (Buffer.compare(zlib.inflateRawSync(auto.data), input) !== 0) fail(`${name} ${level}: auto round trip`);
+      if (auto.strategy !== expected) fail(`${name} ${level}: auto chose ${auto.strategy}`);
+      const fixed = await compress(input, { level });
+      if (auto.data.length > fixed.data.length * 17 / 16 + 64) fail(`${name} ${level}: auto ${auto.data.length} bytes, ${fixed.data.length} with the default`);
+    }
+    for (const strategy of ['default', 'filtered', 'huffman-only', 'rle', 'fixed', 'quick', 'medium']) {
+      const result = await compress(input, { strategy });
+      if (Buffer.compare(zlib.inflateRawSync(result.data), input) !== 0 || result.strategy !== strategy) fail(`${name}: ${strategy}`);
+    }
+  }
+  // medium: close to level 6, better than level 1
+  for (const level of [3, 4, 5]) {
+    const medium = (await compress(Buffer.from(text), { level, strategy: 'medium' })).data;
+    const level1 = zlib.deflateRawSync(text, { level: 1 }).length;
+    const level6 = zlib.deflateRawSync(text, { level: 6 }).length;
+    if (medium.length >= level1 || (level === 5 && medium.length > level6 * 17 / 16)) fail(`medium ${level}: ${medium.length} bytes, level 1 ${level1}, level 6 ${level6}`);
+  }
+  // quick and medium: the same output whatever the size of the writes
+  for (const [strategy, level] of [['quick', 1], ['medium', 3], ['medium', 5]]) {
+    const whole = (await compress(Buffer.from(text), { level, strategy })).data;
+    for (const chunkSize of [100, 1000]) {
+      const small = (await compress(Buffer.from(text), { level, strategy }, chunkSize)).data;
+      if (Buffer.compare(small, whole) !== 0) fail(`${strategy} ${level}: ${small.length} bytes in writes of ${chunkSize}, ${whole.length} in one`);
+    }
+  }
+  // quick and medium: without zlib, in every format, with flush points
+  const unzip = { 'gzip': zlib.gunzipSync, 'deflate': zlib.inflateSync, 'deflate-raw': zlib.inflateRawSync };
+  const mixed = Buffer.concat([Buffer.from(text.slice(0, 300000)), random.subarray(0, 100000), sparse.subarray(0, 300000)]);
+  for (const strategy of ['quick', 'medium']) {
+    for (const type of Object.keys(unzip)) {
+      for (const hibernate of [false, true]) {
+        const cs = new CompressionStreamZlib(type, { strategy, outBuffer: 1000 });
+        const chunks = [];
+        const reader = cs.readable.getReader();
+        const readerTask = (async () => {
+          while (true) {
+            const { done, value } = await reader.read();
+            if (done) break;
+            chunks.push(Buffer.from(value));
+          }
+        })();
+        const writer = cs.writable.getWriter();
+        for (let offset = 0; offset < mixed.length; offset += 7777) {
+          await writer.write(mixed.subarray(offset, offset + 7777));
+          if (hibernate) cs.hibernate();
+        }
+        await writer.close();
+        await readerTask;
+        const data = Buffer.concat(chunks);
+        if (Buffer.compare(unzip[type](data), mixed) !== 0) fail(`${strategy} ${type}: round trip (hibernate ${hibernate})`);
+        if (data.length > mixed.length * 0.6) fail(`${strategy} ${type}: ${data.length} bytes`);
+      }
+    }
+  }
+  let error;
+  try {
+    new CompressionStreamZlib('deflate', { strategy: 'fastest' });
+  } catch (e) {
+    error = e;
+  }
+  if (!error || !/unsupported strategy/.test(error.message)) fail('unknown strategy accepted');
+  console.log('STRATEGY OK');
+  process.exit(0);
+})();
@@ -0,0 +1,62 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_deflate_target.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('TARGET FAILED: %s', message);
+    process.exit(3);
+  };
+
+  async function compress(data, options) {
+    const cs = new CompressionStreamZlib('deflate', options);
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+      }
+    })();
+    for (let offset = 0; offset < data.length; offset += 65536) {
+      await writer.write(data.subarray(offset, offset + 65536));
+    }
+    await writer.close();
+    await readerTask;
+    return Buffer.concat(chunks);
+  }
+
+  let text = '';
+  for (let i = 0; text.length < 8000000; i++) text += `record ${i % 977} value ${(i * 7919) % 10007} status ${i % 3 ? 'ok' : 'retry'}\n`;
+  const plain = Buffer.from(text);
+  const fastest = await compress(plain, { level: 1 });
+  for (const level of [6, 9]) {
+    const fixed = await compress(plain, { level });
+    // a target that is always met keeps the level
+    const met = await compress(plain, { level, maxMsPerMB: 1e6 });
+    if (Buffer.compare(met, fixed) !== 0) fail(`level ${level}: met target changed the output`);
+    // an unreachable one walks down to Huffman coding alone
+    for (const options of [{ maxMsPerMB: 1e-6 }, { targetMBps: 1e9 }]) {
+      const missed = await compress(plain, { level, ...options });
+      if (Buffer.compare(zlib.inflateSync(missed), plain) !== 0) fail(`level ${level}: round trip ${JSON.stringify(options)}`);
+      if (missed.length < fastest.length * 1.5) fail(`level ${level}: ${missed.length} bytes, ${fastest.length} at level 1 ${JSON.stringify(options)}`);
+    }
+  }
+  console.log('TARGET OK');
+  process.exit(0);
+})();
@@ -0,0 +1,80 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import { gzipSync } from 'zlib';
+import { randomFillSync } from 'crypto';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_gzip_multi_member.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const exp = instance.exports;
+
+  const mod = await import('../api/zlib-streams.js');
+  const { DecompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(exp);
+
+  // members of mixed sizes, including an empty one and one larger than the
+  // 64K output buffer, as produced by log rotation or parallel gzip tools
+  const sizes = [1000, 0, 70000, 17, 24000];
+  const parts = sizes.map((n, i) => {
+    const b = Buffer.allocUnsafe(n);
+    if (i % 2) randomFillSync(b); else b.fill('log line ' + i + '\n');
+    return b;
+  });
+  const members = parts.map(p => gzipSync(p));
+  // trailing zero padding is not a gzip member and must be ignored
+  const gz = Buffer.concat([...members, Buffer.alloc(16)]);
+
+  async function run(CHUNK) {
+    const boundaries = [];
+    const ds = new DecompressionStreamZlib('gzip', { onMemberEnd: (m) => boundaries.push(m) });
+    const writer = ds.writable.getWriter();
+    const reader = ds.readable.getReader();
+    const outChunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        outChunks.push(Buffer.from(value));
+      }
+    })();
+    for (let off = 0; off < gz.length; off += CHUNK) {
+      await writer.write(gz.subarray(off, Math.min(off + CHUNK, gz.length)));
+    }
+    await writer.close();
+    await readerTask;
+    return { out: Buffer.concat(outChunks), boundaries };
+  }
+
+  const expected = Buffer.concat(parts);
+  for (const CHUNK of [1, 7, 4096, gz.length]) {
+    const { out, boundaries } = await run(CHUNK);
+    if (Buffer.compare(out, expected) !== 0) {
+      console.error('MULTI-MEMBER FAILED: data mismatch (chunk=%d, got %d bytes, expected %d)', CHUNK, out.length, expected.length);
+      process.exit(3);
+    }
+    if (boundaries.length !== members.length) {
+      console.error('MULTI-MEMBER FAILED: %d boundaries reported, expected %d (chunk=%d)', boundaries.length, members.length, CHUNK);
+      process.exit(4);
+    }
+    let inOff = 0, outOff = 0;
+    for (let i = 0; i < members.length; i++) {
+      inOff += members[i].length;
+      outOff += parts[i].length;
+      const b = boundaries[i];
+      if (b.index !== i || b.inputOffset !== inOff || b.outputOffset !== outOff) {
+        console.error('MULTI-MEMBER FAILED: bad boundary %j, expected input=%d output=%d (chunk=%d)', b, inOff, outOff, CHUNK);
+        process.exit(5);
+      }
+    }
+  }
+
+  console.log('MULTI-MEMBER OK');
+  process.exit(0);
+})();
@@ -0,0 +1,84 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_hibernate.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('HIBERNATE FAILED: %s', message);
+    process.exit(3);
+  };
+  const messages = [];
+  for (let i = 0; i < 200; i++) messages.push(Buffer.from(`{"id":${i},"user":"u${i % 17}","text":"${'hello '.repeat(i % 50)}"}\n`));
+  const plain = Buffer.concat(messages);
+
+  async function collect(readable) {
+    const chunks = [];
+    for (const reader = readable.getReader(); ;) {
+      const { done, value } = await reader.read();
+      if (done) return Buffer.concat(chunks);
+      chunks.push(Buffer.from(value));
+    }
+  }
+
+  const pause = (ms) => new Promise(resolve => setTimeout(resolve, ms));
+
+  // a connection: messages go through deflate then inflate, sampled in between.
+  // The streams hibernate after an idle delay ("idle"), when told to ("call")
+  // or never.
+  async function connection(type, mode) {
+    const compressed = [];
+    const recorder = new TransformStream({ transform(chunk, controller) { compressed.push(Buffer.from(chunk)); controller.enqueue(chunk); } });
+    const options = mode === 'idle' ? { hibernate: 20 } : {};
+    const cs = new CompressionStreamZlib(type, options);
+    const ds = new DecompressionStreamZlib(type, options);
+    const outputTask = collect(cs.readable.pipeThrough(recorder).pipeThrough(ds));
+    const writer = cs.writable.getWriter();
+    let idle = 0;
+    for (let i = 0; i < messages.length; i++) {
+      await writer.write(messages[i]);
+      if (i % 20 !== 19) continue;
+      if (mode === 'idle' && getWasmStats().windows === 0) fail(`${type}: hibernated before the idle delay`);
+      if (mode === 'call') {
+        cs.hibernate();
+        await pause(0);
+        ds.hibernate();
+      } else {
+        await pause(100);
+      }
+      const stats = getWasmStats();
+      idle = Math.max(idle, stats.liveBytes);
+      if (mode && stats.windows !== 0) fail(`${type} (${mode}): ${stats.windows} windows while idle`);
+    }
+    await writer.close();
+    return { output: await outputTask, compressed: Buffer.concat(compressed), idle };
+  }
+
+  const unzip = { 'gzip': zlib.gunzipSync, 'deflate': zlib.inflateSync, 'deflate-raw': zlib.inflateRawSync };
+  for (const type of ['gzip', 'deflate', 'deflate-raw']) {
+    const awake = await connection(type, null);
+    for (const mode of ['idle', 'call']) {
+      const hibernated = await connection(type, mode);
+      if (Buffer.compare(hibernated.output, plain) !== 0) fail(`${type} (${mode}): output`);
+      if (Buffer.compare(unzip[type](hibernated.compressed), plain) !== 0) fail(`${type} (${mode}): compressed stream`);
+      if (hibernated.idle * 10 > awake.idle) fail(`${type} (${mode}): ${hibernated.idle} idle bytes, ${awake.idle} without hibernation`);
+      console.log('%s (%s): %d idle bytes, %d without hibernation', type, mode, hibernated.idle, awake.idle);
+    }
+  }
+  const stats = getWasmStats();
+  if (stats.liveBytes !== 0) fail(`${stats.liveBytes} live bytes after the connections`);
+  console.log('HIBERNATE OK');
+  process.exit(0);
+})();
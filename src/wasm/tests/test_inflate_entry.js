@@ -0,0 +1,105 @@
+import { existsSync, readFileSync, readdirSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+import { performance } from 'perf_hooks';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_inflate_entry.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { inflateEntry, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+  const exp = instance.exports;
+
+  const fail = (message) => {
+    console.error('ENTRY FAILED: %s', message);
+    process.exit(3);
+  };
+  const throws = (fn) => {
+    try {
+      fn();
+    } catch (error) {
+      return true;
+    }
+    return false;
+  };
+
+  // the whole entry through inflate9_process and a 64K output buffer, as
+  // DecompressionStreamZlib does
+  function processEntry(data, size) {
+    const handle = exp.inflate9_new();
+    const inPtr = exp.malloc(data.length);
+    const outPtr = exp.malloc(65536);
+    const output = new Uint8Array(size);
+    try {
+      exp.inflate9_init_raw(handle);
+      new Uint8Array(exp.memory.buffer).set(data, inPtr);
+      let consumed = 0, produced = 0;
+      while (true) {
+        const result = exp.inflate9_process(handle, inPtr + consumed, data.length - consumed, outPtr, 65536, 4);
+        const count = result & 0x00ffffff;
+        output.set(new Uint8Array(exp.memory.buffer, outPtr, count), produced);
+        produced += count;
+        const used = exp.inflate9_last_consumed(handle);
+        consumed += used;
+        // Z_FINISH with a full output buffer returns Z_BUF_ERROR: go on
+        const code = result >> 24;
+        if (code === 1 || (code !== 0 && code !== -5) || (used === 0 && count === 0)) return output.subarray(0, produced);
+      }
+    } finally {
+      exp.inflate9_end(handle);
+      exp.free(inPtr);
+      exp.free(outPtr);
+    }
+  }
+
+  // deflate entries
+  let x = 3;
+  const next = () => (x = (Math.imul(x, 1103515245) + 12345) >>> 0) >>> 16;
+  let text = '';
+  while (text.length < 2000000) text += `${['entry', 'size', 'crc', 'offset'][next() % 4]} ${next() % 5000}\n`;
+  const plain = Buffer.from(text);
+  for (const entry of [plain, plain.subarray(0, 1), Buffer.alloc(0), Buffer.alloc(300000, 'z')]) {
+    const data = zlib.deflateRawSync(entry);
+    const output = inflateEntry(data, entry.length);
+    if (Buffer.compare(Buffer.from(output), entry) !== 0) fail(`deflate entry of ${entry.length} bytes`);
+  }
+  const data = zlib.deflateRawSync(plain);
+  if (!throws(() => inflateEntry(data, plain.length - 1))) fail('entry larger than its size');
+  if (!throws(() => inflateEntry(data, plain.length + 1))) fail('entry smaller than its size');
+  if (!throws(() => inflateEntry(data.subarray(0, data.length >> 1), plain.length))) fail('truncated entry');
+
+  // deflate64 entries, against inflate9_process
+  const refDir = join('test', 'ref-data');
+  let largest = null;
+  for (const file of readdirSync(refDir).filter(name => name.endsWith('.deflate64'))) {
+    const entry = readFileSync(join(refDir, file));
+    const reference = processEntry(entry, 16 * 1024 * 1024);
+    const output = inflateEntry(entry, reference.length, 'deflate64-raw');
+    if (Buffer.compare(Buffer.from(output), Buffer.from(reference)) !== 0) fail(`${file}: output`);
+    if (!largest || reference.length > largest.size) largest = { entry, size: reference.length, file };
+  }
+  if (getWasmStats().liveBytes !== 0) fail(`${getWasmStats().liveBytes} live bytes after the entries`);
+
+  // whole-entry extraction: inflateEntry against inflate9_process
+  const time = (fn) => {
+    let best = Infinity;
+    for (let run = 0; run < 20; run++) {
+      const start = performance.now();
+      fn();
+      best = Math.min(best, performance.now() - start);
+    }
+    return largest.size / best / 1000;
+  };
+  const back = time(() => inflateEntry(largest.entry, largest.size, 'deflate64-raw'));
+  const windowed = time(() => processEntry(largest.entry, largest.size));
+  console.log('ENTRY OK (%s: inflateEntry %s MB/s, inflate9_process %s MB/s)', largest.file, back.toFixed(0), windowed.toFixed(0));
+  process.exit(0);
+})();
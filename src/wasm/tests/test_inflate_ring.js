@@ -0,0 +1,115 @@
+import { existsSync, readFileSync, readdirSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_inflate_ring.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('RING FAILED: %s', message);
+    process.exit(3);
+  };
+
+  // decompress data written in chunks of chunkSize, checking that the stream
+  // never allocates a window in ring mode
+  async function decompress(type, data, options, chunkSize = 16384) {
+    const ds = new DecompressionStreamZlib(type, options);
+    const writer = ds.writable.getWriter();
+    const reader = ds.readable.getReader();
+    const chunks = [];
+    const readerTask = (async () => {
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        chunks.push(Buffer.from(value));
+        if (options.outputRing && getWasmStats().windows !== 0) fail(`${type}: window allocated`);
+      }
+    })();
+    const writerTask = (async () => {
+      for (let offset = 0; offset < data.length; offset += chunkSize) {
+        await writer.write(data.subarray(offset, offset + chunkSize));
+      }
+      await writer.close();
+    })();
+    await Promise.all([readerTask, writerTask]);
+    return Buffer.concat(chunks);
+  }
+
+  // several times the ring sizes, with matches at all distances
+  let x = 7;
+  const next = () => (x = (Math.imul(x, 1103515245) + 12345) >>> 0) >>> 16;
+  const words = [];
+  for (let i = 0; i < 3000; i++) words.push(`w${next() % 100000}`);
+  let text = '';
+  while (text.length < 3000000) text += `${words[next() % words.length]}${next() % 9 ? ' ' : '\n'}`;
+  const plain = Buffer.from(text);
+  const half = plain.length >> 1;
+
+  const inputs = {
+    'deflate-raw': zlib.deflateRawSync(plain),
+    'deflate': zlib.deflateSync(plain, { level: 9 }),
+    // the ring carries over a member boundary
+    'gzip': Buffer.concat([zlib.gzipSync(plain.subarray(0, half)), zlib.gzipSync(plain.subarray(half), { level: 1 })])
+  };
+  for (const [type, data] of Object.entries(inputs)) {
+    for (const outputRing of [65536, 262144, 1 << 23]) {
+      for (const chunkSize of [1000, 65536]) {
+        const output = await decompress(type, data, { outputRing }, chunkSize);
+        if (Buffer.compare(output, plain) !== 0) fail(`${type}: ring ${outputRing}, chunks ${chunkSize}`);
+      }
+    }
+  }
+
+  // a second member cannot match into the first one
+  const first = plain.subarray(0, 4096);
+  const second = zlib.deflateRawSync(first, { dictionary: first });
+  const trailer = Buffer.alloc(8);
+  trailer.writeUInt32LE(zlib.crc32(first), 0);
+  trailer.writeUInt32LE(first.length, 4);
+  const crossing = Buffer.concat([zlib.gzipSync(first), Buffer.from([0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff]), second, trailer]);
+  let failed = false;
+  try {
+    await decompress('gzip', crossing, { outputRing: 65536 });
+  } catch (error) {
+    failed = true;
+  }
+  if (!failed) fail('gzip: distance into the previous member');
+
+  // deflate64 payloads, against the window mode
+  const refDir = join('test', 'ref-data');
+  for (const file of readdirSync(refDir).filter(name => name.endsWith('.deflate64'))) {
+    const data = readFileSync(join(refDir, file));
+    const expected = await decompress('deflate64-raw', data, {});
+    for (const outputRing of [131072, 1 << 20]) {
+      for (const chunkSize of [7, 4096]) {
+        const output = await decompress('deflate64-raw', data, { outputRing }, chunkSize);
+        if (Buffer.compare(output, expected) !== 0) fail(`${file}: ring ${outputRing}, chunks ${chunkSize}`);
+      }
+    }
+  }
+
+  for (const [type, outputRing] of [['deflate-raw', 32768], ['deflate64-raw', 65536], ['gzip', 100000], ['deflate', 1 << 24]]) {
+    let thrown = false;
+    try {
+      new DecompressionStreamZlib(type, { outputRing });
+    } catch (error) {
+      thrown = true;
+    }
+    if (!thrown) fail(`${type}: ring of ${outputRing} bytes accepted`);
+  }
+  const stats = getWasmStats();
+  if (stats.liveBytes !== 0) fail(`${stats.liveBytes} live bytes after the streams ended`);
+  console.log('RING OK');
+  process.exit(0);
+})();
@@ -0,0 +1,141 @@
+import { existsSync, readFileSync } from 'fs';
+import { join, resolve } from 'path';
+import { Worker } from 'worker_threads';
+import { pathToFileURL } from 'url';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_inflate_speculative.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = resolve(process.argv[2] || join('dist','zlib-streams-dev.wasm'));
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+// worker: own wasm instance, decodes the chunks it receives
+const workerSource = `
+const { parentPort, workerData } = require('worker_threads');
+const { readFileSync } = require('fs');
+(async () => {
+  const { instance } = await WebAssembly.instantiate(readFileSync(workerData.wasmPath), { env: { emscripten_notify_memory_growth: () => {} } });
+  const mod = await import(workerData.apiUrl);
+  mod.setWasmExports(instance.exports);
+  parentPort.on('message', ({ id, task }) => {
+    const result = mod.inflateSpeculative(task);
+    parentPort.postMessage({ id, result }, result.symbols ? [result.symbols.buffer] : []);
+  });
+})();
+`;
+
+function createPool(size) {
+  const apiUrl = pathToFileURL(resolve('src/wasm/api/zlib-streams.js')).href;
+  const workers = [], callbacks = new Map();
+  let id = 0;
+  for (let i = 0; i < size; i++) {
+    const worker = new Worker(workerSource, { eval: true, workerData: { wasmPath, apiUrl } });
+    worker.on('message', ({ id, result }) => { callbacks.get(id)(result); callbacks.delete(id); });
+    workers.push(worker);
+  }
+  return {
+    runTask: (task) => new Promise((resolve) => {
+      callbacks.set(++id, resolve);
+      workers[id % size].postMessage({ id, task }, [task.data.buffer]);
+    }),
+    close: () => Promise.all(workers.map(worker => worker.terminate()))
+  };
+}
+
+// a single fixed Huffman block of the literals of bytes
+function fixedBlock(bytes) {
+  const out = [];
+  let bits = 0, count = 0;
+  const put = (value, length) => {
+    bits |= value << count;
+    count += length;
+    while (count >= 8) { out.push(bits & 0xff); bits >>>= 8; count -= 8; }
+  };
+  // Huffman codes go most significant bit first
+  const code = (value, length) => {
+    let reversed = 0;
+    for (let i = 0; i < length; i++) reversed |= ((value >> i) & 1) << (length - 1 - i);
+    put(reversed, length);
+  };
+  put(3, 3);
+  for (const byte of bytes) {
+    if (byte < 144) code(0x30 + byte, 8);
+    else code(0x190 + byte - 144, 9);
+  }
+  code(0, 7);
+  if (count) out.push(bits & 0xff);
+  return Buffer.from(out);
+}
+
+async function collect(readable) {
+  const reader = readable.getReader();
+  const chunks = [];
+  while (true) {
+    const { done, value } = await reader.read();
+    if (done) break;
+    chunks.push(Buffer.from(value));
+  }
+  return Buffer.concat(chunks);
+}
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { decompressSpeculative, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  // text with long-range matches, an incompressible run and a zero run
+  let text = '';
+  for (let i = 0; text.length < 2000000; i++) text += `record ${i % 977} value ${(i * 7919) % 10007} status ${i % 3 ? 'ok' : 'retry'}\n`;
+  const random = Buffer.alloc(200000);
+  for (let i = 0, x = 1; i < random.length; i++) { x = (Math.imul(x, 1103515245) + 12345) >>> 0; random[i] = x >>> 24; }
+  const long = Buffer.alloc(700000);
+  for (let i = 0, x = 5; i < long.length; i++) { x = (Math.imul(x, 1103515245) + 12345) >>> 0; long[i] = x >>> 24; }
+  const plain = Buffer.concat([Buffer.from(text.slice(0, 1000000)), random, Buffer.alloc(100000), Buffer.from(text.slice(1000000))]);
+  const cases = {
+    raw: ['deflate-raw', zlib.deflateRawSync(plain), plain],
+    gzip: ['gzip', zlib.gzipSync(plain, { level: 9 }), plain],
+    // fixed and stored blocks are never found by trial: sequential fallback
+    fixed: ['gzip', zlib.gzipSync(plain, { strategy: zlib.constants.Z_FIXED }), plain],
+    stored: ['gzip', zlib.gzipSync(plain.subarray(0, 300000), { level: 0 }), plain.subarray(0, 300000)],
+    // a block longer than twice SPEC_LOOKAHEAD: the sequential step retries
+    long: ['deflate-raw', fixedBlock(long), long],
+    members: ['gzip', Buffer.concat([zlib.gzipSync(plain), zlib.gzipSync('tail')]), Buffer.concat([plain, Buffer.from('tail')])]
+  };
+
+  const pool = createPool(3);
+  try {
+    for (const [name, [type, data, expected]] of Object.entries(cases)) {
+      for (const chunkSize of [65536, 300000]) {
+        for (const runTask of [undefined, pool.runTask]) {
+          const out = await collect(decompressSpeculative(new Uint8Array(data), type, { chunkSize, runTask, concurrency: 3 }));
+          if (Buffer.compare(out, expected) !== 0) {
+            console.error('SPECULATIVE FAILED: %s mismatch (chunk=%d, workers=%s, got %d bytes)', name, chunkSize, !!runTask, out.length);
+            process.exit(3);
+          }
+        }
+      }
+    }
+
+    const corrupted = Buffer.from(cases.gzip[1]);
+    corrupted[corrupted.length - 6] ^= 1;
+    let error;
+    try {
+      await collect(decompressSpeculative(new Uint8Array(corrupted), 'gzip', { chunkSize: 65536, runTask: pool.runTask }));
+    } catch (e) {
+      error = e;
+    }
+    if (!error || !/incorrect data check/.test(error.message)) {
+      console.error('SPECULATIVE FAILED: corrupted trailer not detected (%s)', error && error.message);
+      process.exit(4);
+    }
+  } finally {
+    await pool.close();
+  }
+
+  console.log('SPECULATIVE OK');
+  process.exit(0);
+})();
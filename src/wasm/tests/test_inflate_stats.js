@@ -0,0 +1,87 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_inflate_stats.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams_stats.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { DecompressionStreamZlib, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  async function decode(type, data) {
+    let stats;
+    const ds = new DecompressionStreamZlib(type, { onStats: (s) => { stats = s; } });
+    const writer = ds.writable.getWriter();
+    const reader = ds.readable.getReader();
+    const readerTask = (async () => {
+      let size = 0;
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        size += value.length;
+      }
+      return size;
+    })();
+    await writer.write(data);
+    await writer.close();
+    return { size: await readerTask, stats };
+  }
+
+  let text = '';
+  for (let i = 0; text.length < 300000; i++) text += `entry ${i % 500} ${(i * 31) % 997}\n`;
+  const plain = Buffer.from(text);
+  const dynamic = await decode('gzip', zlib.gzipSync(plain));
+  if (!dynamic.stats) {
+    // default build: instrumentation compiled out
+    if (dynamic.size !== plain.length) {
+      console.error('STATS FAILED: bad output size %d', dynamic.size);
+      process.exit(3);
+    }
+    console.log('STATS OK (not compiled in)');
+    process.exit(0);
+  }
+
+  const fail = (message, stats) => {
+    console.error('STATS FAILED: %s %j', message, stats);
+    process.exit(4);
+  };
+  const sum = (array) => array.reduce((a, b) => a + b, 0);
+  let stats = dynamic.stats;
+  if (stats.dynamic === 0 || stats.fixed !== 0 || stats.tables + 2 * stats.cached !== 3 * stats.dynamic) fail('dynamic blocks', stats);
+  if (stats.fast + stats.slow === 0 || sum(stats.lengths) === 0 || sum(stats.lengths) !== sum(stats.distances)) fail('symbols', stats);
+  if (stats.lengths[0] !== 0 || stats.lengths[1] === 0) fail('length histogram', stats);
+  stats = (await decode('deflate-raw', zlib.deflateRawSync(plain, { strategy: zlib.constants.Z_FIXED }))).stats;
+  if (stats.fixed === 0 || stats.dynamic !== 0 || stats.tables !== 0) fail('fixed blocks', stats);
+  stats = (await decode('deflate', zlib.deflateSync(plain, { level: 0 }))).stats;
+  if (stats.stored === 0 || stats.fast + stats.slow !== 0 || sum(stats.lengths) !== 0) fail('stored blocks', stats);
+
+  // the same message behind full flushes: the same block header each time,
+  // whose tables are built once
+  const message = plain.subarray(0, 2000);
+  const messages = await new Promise((resolve) => {
+    const deflater = zlib.createDeflateRaw();
+    const chunks = [];
+    deflater.on('data', (chunk) => chunks.push(chunk));
+    deflater.on('end', () => resolve(Buffer.concat(chunks)));
+    const send = (count) => {
+      if (count === 0) { deflater.end(); return; }
+      deflater.write(message);
+      deflater.flush(zlib.constants.Z_FULL_FLUSH, () => send(count - 1));
+    };
+    send(20);
+  });
+  const repeated = await decode('deflate-raw', messages);
+  stats = repeated.stats;
+  if (repeated.size !== 20 * message.length || stats.dynamic < 20 || stats.cached < 18) fail('repeated headers', stats);
+
+  console.log('STATS OK');
+  process.exit(0);
+})();
@@ -0,0 +1,110 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_memory_budget.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+// one default deflate stream reserves ~260K: the budget admits one at a time
+const BUDGET = 400000;
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, setWasmExports, setMemoryBudget, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('BUDGET FAILED: %s', message);
+    process.exit(3);
+  };
+  let text = '';
+  for (let i = 0; text.length < 300000; i++) text += `item ${i % 700} ${(i * 13) % 4099}\n`;
+  const plain = Buffer.from(text);
+  let maxReserved = 0;
+
+  async function compress(options, data = plain) {
+    const cs = new CompressionStreamZlib('deflate-raw', options);
+    const writer = cs.writable.getWriter();
+    const reader = cs.readable.getReader();
+    const readerTask = (async () => {
+      const chunks = [];
+      while (true) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        maxReserved = Math.max(maxReserved, getWasmStats().reservedBytes);
+        chunks.push(Buffer.from(value));
+      }
+      return Buffer.concat(chunks);
+    })();
+    await writer.write(data);
+    await writer.close();
+    return readerTask;
+  }
+
+  setMemoryBudget(BUDGET);
+  // queued: streams wait for each other instead of failing
+  const outputs = await Promise.all([0, 1, 2, 3].map(() => compress({})));
+  for (const out of outputs) {
+    if (Buffer.compare(zlib.inflateRawSync(out), plain) !== 0) fail('queued stream output');
+  }
+  if (maxReserved === 0 || maxReserved > BUDGET) fail('reserved ' + maxReserved + ' bytes');
+
+  // while a stream holds the budget: downgrade or fail
+  const holder = new CompressionStreamZlib('deflate-raw');
+  const holderWriter = holder.writable.getWriter();
+  const holderTask = holder.readable.pipeTo(new WritableStream());
+  await holderWriter.write(plain.subarray(0, 1000));
+  const downgraded = await compress({ memoryPolicy: 'downgrade' });
+  if (Buffer.compare(zlib.inflateRawSync(downgraded), plain) !== 0) fail('downgraded stream output');
+  let error;
+  try {
+    await compress({ memoryPolicy: 'error' });
+  } catch (e) {
+    error = e;
+  }
+  if (!error || !/init failed:-4/.test(error.message)) fail('no error with memoryPolicy "error"');
+  await holderWriter.close();
+  await holderTask;
+
+  // levels 10 to 12 reserve what deflate_quick.c allocates, about 1.5 MB
+  setMemoryBudget(2000000);
+  const optimal = new CompressionStreamZlib('deflate-raw', { level: 10 });
+  const optimalWriter = optimal.writable.getWriter();
+  const optimalTask = optimal.readable.pipeTo(new WritableStream());
+  await optimalWriter.write(plain.subarray(0, 1000));
+  if (getWasmStats().reservedBytes < 1400000) fail('optimal stream reserved ' + getWasmStats().reservedBytes + ' bytes');
+  error = undefined;
+  try {
+    await compress({ level: 10, memoryPolicy: 'error' });
+  } catch (e) {
+    error = e;
+  }
+  if (!error || !/init failed:-4/.test(error.message)) fail('two optimal streams within 2 MB');
+  await optimalWriter.close();
+  await optimalTask;
+
+  // a failed allocation with no other reservation to wait for: an error,
+  // not a stream queued forever
+  setWasmExports({ ...instance.exports, deflate_init_sized: () => -4 });
+  error = undefined;
+  try {
+    await compress({});
+  } catch (e) {
+    error = e;
+  }
+  setWasmExports(instance.exports);
+  if (!error || !/init failed:-4/.test(error.message)) fail('stream queued with nothing to wait for');
+
+  setMemoryBudget(0);
+  const stats = getWasmStats();
+  if (stats.budgetBytes !== 0 || stats.deflateContexts !== 0) fail('final stats ' + JSON.stringify(stats));
+
+  console.log('BUDGET OK');
+  process.exit(0);
+})();
@@ -0,0 +1,151 @@
+import { existsSync, readFileSync } from 'fs';
+import { join, resolve } from 'path';
+import { Worker } from 'worker_threads';
+import { pathToFileURL } from 'url';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_parallel_inflate.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = resolve(process.argv[2] || join('dist','zlib-streams-dev.wasm'));
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+// worker: own wasm instance, decodes the segments it receives
+const workerSource = `
+const { parentPort, workerData } = require('worker_threads');
+const { readFileSync } = require('fs');
+(async () => {
+  const { instance } = await WebAssembly.instantiate(readFileSync(workerData.wasmPath), { env: { emscripten_notify_memory_growth: () => {} } });
+  const mod = await import(workerData.apiUrl);
+  mod.setWasmExports(instance.exports);
+  parentPort.on('message', ({ id, task }) => parentPort.postMessage({ id, result: mod.inflateSegment(task) }));
+})();
+`;
+
+function createPool(size) {
+  const apiUrl = pathToFileURL(resolve('src/wasm/api/zlib-streams.js')).href;
+  const workers = [], callbacks = new Map();
+  let id = 0;
+  for (let i = 0; i < size; i++) {
+    const worker = new Worker(workerSource, { eval: true, workerData: { wasmPath, apiUrl } });
+    worker.on('message', ({ id, result }) => { callbacks.get(id)(result); callbacks.delete(id); });
+    workers.push(worker);
+  }
+  return {
+    runTask: (task) => new Promise((resolve) => {
+      callbacks.set(++id, resolve);
+      workers[id % size].postMessage({ id, task });
+    }),
+    close: () => Promise.all(workers.map(worker => worker.terminate()))
+  };
+}
+
+function text(size, seed) {
+  let s = '', i = 0;
+  while (s.length < size) s += `line ${seed} ${i++} ${(i * 7919) % 1000}\n`;
+  return Buffer.from(s.slice(0, size));
+}
+
+async function deflateWithFlush(parts, flush, raw, options = {}) {
+  const stream = raw ? zlib.createDeflateRaw(options) : zlib.createGzip(options);
+  const chunks = [];
+  stream.on('data', chunk => chunks.push(chunk));
+  for (const part of parts) {
+    stream.write(part);
+    await new Promise(done => stream.flush(flush, done));
+  }
+  stream.end();
+  await new Promise(done => stream.on('end', done));
+  return Buffer.concat(chunks);
+}
+
+async function collect(readable) {
+  const reader = readable.getReader();
+  const chunks = [];
+  while (true) {
+    const { done, value } = await reader.read();
+    if (done) break;
+    chunks.push(Buffer.from(value));
+  }
+  return Buffer.concat(chunks);
+}
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { decompressParallel, inflateSegment, setWasmExports } = mod;
+  setWasmExports(instance.exports);
+
+  const parts = [text(300000, 1), text(500000, 2), text(10, 3), text(700000, 4)];
+  const expected = Buffer.concat(parts);
+  const { Z_FULL_FLUSH, Z_SYNC_FLUSH } = zlib.constants;
+  // stored blocks keep the 1f 8b 08 00 of the input: false member starts
+  // inside the segments that follow the full flush points
+  const magic = Buffer.from([0x1f, 0x8b, 8, 0]);
+  const magicParts = parts.map(p => Buffer.concat([p.subarray(0, 1000), magic, p.subarray(1000, 200000), magic, p.subarray(200000)]));
+  const cases = {
+    members: ['gzip', Buffer.concat(parts.map(p => zlib.gzipSync(p)))],
+    fullFlush: ['gzip', await deflateWithFlush(parts, Z_FULL_FLUSH)],
+    // 00 00 ff ff without a dictionary reset: segments are decoded again
+    syncFlush: ['gzip', await deflateWithFlush(parts, Z_SYNC_FLUSH)],
+    rawFullFlush: ['deflate-raw', await deflateWithFlush(parts, Z_FULL_FLUSH, true)],
+    mixed: ['gzip', Buffer.concat([
+      await deflateWithFlush(parts.slice(0, 2), Z_FULL_FLUSH),
+      zlib.gzipSync(parts[2]),
+      await deflateWithFlush(parts.slice(3), Z_SYNC_FLUSH),
+      Buffer.alloc(5)
+    ])],
+    falseMember: ['gzip', Buffer.concat([
+      await deflateWithFlush(magicParts, Z_FULL_FLUSH, false, { level: 0 }),
+      zlib.gzipSync(magic)
+    ]), Buffer.concat([...magicParts, magic])]
+  };
+
+  const pool = createPool(3);
+  try {
+    for (const [name, [type, data, output = expected]] of Object.entries(cases)) {
+      for (const minSegmentSize of [1, 100000, 1 << 20]) {
+        for (const runTask of [undefined, pool.runTask]) {
+          const out = await collect(decompressParallel(new Uint8Array(data), type, { minSegmentSize, runTask, concurrency: 3 }));
+          if (Buffer.compare(out, output) !== 0) {
+            console.error('PARALLEL FAILED: %s mismatch (min=%d, workers=%s, got %d bytes)', name, minSegmentSize, !!runTask, out.length);
+            process.exit(3);
+          }
+        }
+      }
+    }
+
+    // real boundaries are decoded once: no segment is merged or retried
+    for (const name of ['members', 'fullFlush', 'rawFullFlush']) {
+      const [type, data] = cases[name];
+      let decoded = 0;
+      const runTask = (task) => { decoded += task.data.length; return inflateSegment(task); };
+      await collect(decompressParallel(new Uint8Array(data), type, { minSegmentSize: 1, runTask }));
+      if (decoded !== data.length) {
+        console.error('PARALLEL FAILED: %s decoded %d bytes of input for %d', name, decoded, data.length);
+        process.exit(3);
+      }
+    }
+
+    // a corrupted CRC in the trailer of a split member must be reported
+    const corrupted = Buffer.from(cases.fullFlush[1]);
+    corrupted[corrupted.length - 6] ^= 1;
+    let error;
+    try {
+      await collect(decompressParallel(new Uint8Array(corrupted), 'gzip', { minSegmentSize: 1, runTask: pool.runTask }));
+    } catch (e) {
+      error = e;
+    }
+    if (!error || !/incorrect data check/.test(error.message)) {
+      console.error('PARALLEL FAILED: corrupted trailer not detected (%s)', error && error.message);
+      process.exit(4);
+    }
+  } finally {
+    await pool.close();
+  }
+
+  console.log('PARALLEL OK');
+  process.exit(0);
+})();
@@ -34,6 +34,8 @@ if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process
   let medianArg = argv.find(a => a.startsWith('--median='));
   const MEDIAN_RUNS = medianArg ? Number(medianArg.split('=')[1]) : 3;
   const measureRss = argv.includes('--measure-rss');
+  // --skip-incompressible: store the random input instead of matching it
+  const skipIncompressible = argv.includes('--skip-incompressible');
   // default sizes: 10MB, 50MB, 100MB. Large sizes optional via --include-large
   const sizes = [10 * 1024 * 1024, 50 * 1024 * 1024, 100 * 1024 * 1024];
   if (includeLarge) {
@@ -59,9 +61,9 @@ if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process
 
         // per-run stream options (zero-copy by default, allow forcing Buffer output)
         const streamOpts = (() => {
-          if (OUTPUT_MODE === 'buffer') return { wasm: expRun, forceBuffer: true, zeroCopyOutput: false };
+          if (OUTPUT_MODE === 'buffer') return { wasm: expRun, forceBuffer: true, zeroCopyOutput: false, skipIncompressible };
           // 'zero' or any other value -> zero-copy output
-          return { wasm: expRun, zeroCopyOutput: true };
+          return { wasm: expRun, zeroCopyOutput: true, skipIncompressible };
         })();
 
         // allocate and fill source buffer once per size and reuse for MEDIAN runs
@@ -0,0 +1,76 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_shared_buffers.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+const STREAMS = 32;
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message) => {
+    console.error('SHARED BUFFERS FAILED: %s', message);
+    process.exit(3);
+  };
+  const used = () => { const s = getWasmStats(); return s.heapBytes - s.freeBytes; };
+
+  // interleaved round trips: every stream borrows the same staging buffers
+  const inputs = [];
+  for (let n = 0; n < STREAMS; n++) {
+    let text = '';
+    for (let i = 0; text.length < 50000 + n * 1000; i++) text += `stream ${n} line ${i} ${(i * n) % 101}\n`;
+    inputs.push(Buffer.from(text));
+  }
+  const pipelines = inputs.map(() => {
+    const pump = new TransformStream();
+    const cs = new CompressionStreamZlib('gzip', { sharedBuffers: true });
+    const ds = new DecompressionStreamZlib('gzip', { sharedBuffers: true });
+    return { writer: pump.writable.getWriter(), reader: pump.readable.pipeThrough(cs).pipeThrough(ds).getReader() };
+  });
+  const outputs = pipelines.map(async ({ reader }) => {
+    const chunks = [];
+    while (true) {
+      const { done, value } = await reader.read();
+      if (done) break;
+      chunks.push(Buffer.from(value));
+    }
+    return Buffer.concat(chunks);
+  });
+  for (let offset = 0; offset < 100000; offset += 7000) {
+    await Promise.all(pipelines.map(({ writer }, n) => offset < inputs[n].length && writer.write(inputs[n].subarray(offset, offset + 7000))));
+  }
+  await Promise.all(pipelines.map(({ writer }) => writer.close()));
+  const results = await Promise.all(outputs);
+  results.forEach((out, n) => { if (Buffer.compare(out, inputs[n]) !== 0) fail('stream ' + n + ' output'); });
+
+  // idle streams: the shared ones only hold their zlib state
+  const idle = async (options) => {
+    const start = used();
+    const streams = [];
+    for (let n = 0; n < STREAMS; n++) {
+      const ds = new DecompressionStreamZlib('deflate-raw', options);
+      const writer = ds.writable.getWriter();
+      ds.readable.pipeTo(new WritableStream());
+      await writer.write(zlib.deflateRawSync(inputs[n]));
+      streams.push(writer);
+    }
+    const perStream = (used() - start) / STREAMS;
+    await Promise.all(streams.map(writer => writer.close()));
+    return perStream;
+  };
+  const own = await idle({});
+  const shared = await idle({ sharedBuffers: true });
+  if (own - shared < 2 * 64 * 1024) fail(`idle stream: ${own} bytes with own buffers, ${shared} shared`);
+  console.log('SHARED BUFFERS OK (%d bytes per idle stream, %d with own buffers)', Math.round(shared), Math.round(own));
+  process.exit(0);
+})();
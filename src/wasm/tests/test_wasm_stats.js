@@ -0,0 +1,63 @@
+import { existsSync, readFileSync } from 'fs';
+import { join } from 'path';
+import zlib from 'zlib';
+
+if (process.argv.length < 2) {
+  console.error('usage: node test_wasm_stats.js [wasm]');
+  process.exit(2);
+}
+const wasmPath = process.argv[2] || join('dist','zlib-streams-dev.wasm');
+if (!existsSync(wasmPath)) { console.error('wasm not found:', wasmPath); process.exit(2); }
+
+(async ()=>{
+  const wasmBuf = readFileSync(wasmPath);
+  const { instance } = await WebAssembly.instantiate(wasmBuf, { env: { emscripten_notify_memory_growth: ()=>{} } });
+  const mod = await import('../api/zlib-streams.js');
+  const { CompressionStreamZlib, DecompressionStreamZlib, setWasmExports, getWasmStats } = mod;
+  setWasmExports(instance.exports);
+
+  const fail = (message, stats) => {
+    console.error('WASM STATS FAILED: %s %j', message, stats);
+    process.exit(3);
+  };
+  const base = getWasmStats();
+  if (!base) fail('missing wasm_stats export', base);
+
+  let text = '';
+  for (let i = 0; text.length < 200000; i++) text += `line ${i % 300} ${(i * 17) % 1009}\n`;
+  const plain = Buffer.from(text);
+
+  // stats sampled while both streams are open, once the inflate window exists
+  let during;
+  const ds = new DecompressionStreamZlib('deflate-raw', { outBuffer: 4096 });
+  const cs = new CompressionStreamZlib('gzip');
+  const csWriter = cs.writable.getWriter();
+  const writer = ds.writable.getWriter();
+  const reader = ds.readable.getReader();
+  const readerTask = (async () => {
+    let size = 0;
+    while (true) {
+      const { done, value } = await reader.read();
+      if (done) break;
+      if (!during) during = getWasmStats();
+      size += value.length;
+    }
+    return size;
+  })();
+  await writer.write(zlib.deflateRawSync(plain));
+  await writer.close();
+  const size = await readerTask;
+  if (size !== plain.length) fail('bad output size ' + size, during);
+  if (during.inflateContexts !== base.inflateContexts + 1 || during.deflateContexts !== base.deflateContexts + 1) fail('live contexts', during);
+  if (during.windows < base.windows + 2 || during.liveBytes <= base.liveBytes || during.zlibBytes <= base.zlibBytes) fail('live memory', during);
+  await csWriter.close();
+  await cs.readable.pipeTo(new WritableStream());
+
+  const after = getWasmStats();
+  if (after.liveBytes !== base.liveBytes || after.zlibBytes !== base.zlibBytes || after.windows !== base.windows) fail('leak', after);
+  if (after.inflateContexts + after.inflate9Contexts + after.deflateContexts !== 0) fail('contexts not released', after);
+  if (after.peakBytes < during.liveBytes || after.memoryBytes !== instance.exports.memory.buffer.byteLength) fail('peak/memory', after);
+
+  console.log('WASM STATS OK');
+  process.exit(0);
+})();
@@ -1,19 +1,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <malloc.h>
 #include "wasm_stream_common.h"
 #include "allocator.h"
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
 
-unsigned wasm_stream_new(void) {
-  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)malloc(sizeof(*c));
+// Live contexts, walked by wasm_stats
+static struct wasm_stream_ctx *live_streams;
+
+unsigned wasm_stream_new(size_t size, unsigned kind) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)malloc(size);
   if (!c)
     return 0;
-  memset(c, 0, sizeof(*c));
+  memset(c, 0, size);
   c->strm.zalloc = my_zalloc;
   c->strm.zfree = my_zfree;
   c->strm.opaque = Z_NULL;
-  c->inbuf = NULL;
-  c->inbuf_sz = 0;
+  c->kind = kind;
+  c->size = (unsigned)size;
+  c->next = live_streams;
+  if (live_streams)
+    live_streams->prev = c;
+  live_streams = c;
+  wasm_alloc_account((long)size);
   return (unsigned)(uintptr_t)c;
 }
 
@@ -21,12 +33,91 @@ int wasm_stream_end(unsigned zptr, int (*end_func)(z_stream *)) {
   struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
-  int r = end_func(&c->strm);
-  free(c->inbuf);
+  // a hibernated deflate stream has no state: ended before finishing
+  int r = c->hib && c->strm.state == Z_NULL ? Z_DATA_ERROR : end_func(&c->strm);
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    live_streams = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  wasm_alloc_account(-(long)c->size);
+  wasm_alloc.reserved -= c->reserved;
+  if (c->hib) {
+    wasm_alloc_account(-(long)(offsetof(struct wasm_hibernation, data) +
+                               c->hib->packed));
+    free(c->hib);
+  }
+  if (c->ring) {
+    wasm_alloc_account(-(long)(sizeof(struct wasm_ring) +
+                               (c->ring->fixed ? 0 : c->ring->size)));
+    free(c->ring);
+  }
   free(c);
   return r;
 }
 
+// zlib's allocations for a stream, see "Memory Footprint" in zconf.h. The
+// deflate_state size is not visible here: use zconf.h's "few kilobytes".
+static size_t stream_cost(unsigned kind, int window_bits, int mem_level) {
+  if (window_bits < 0)
+    window_bits = -window_bits;
+  if (window_bits > 16)
+    window_bits -= 16;
+  if (window_bits < 8)
+    window_bits = MAX_WBITS;
+  if (kind != WASM_STREAM_DEFLATE) { // inflate's window is twice its size
+    size_t cost = ((size_t)2 << window_bits) + sizeof(struct inflate_state);
+#if TABLE_CACHE > 0
+    cost += TABLE_CACHE * sizeof(table_entry); // allocated on a repeat
+#endif
+    return cost;
+  }
+  if (window_bits == 8)
+    window_bits = 9;
+  return ((size_t)1 << (window_bits + 2)) + ((size_t)1 << (mem_level + 9)) +
+         6 * 1024;
+}
+
+/* Reserve the memory of a stream about to be initialized with window_bits
+   and mem_level (ignored by inflate) from the budget, until wasm_stream_end.
+   Return Z_MEM_ERROR if it does not fit, unless no other stream holds a
+   reservation: a stream larger than the budget still runs alone. */
+int wasm_stream_reserve(unsigned zptr, int window_bits, int mem_level) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  return wasm_stream_reserve_bytes(
+      zptr, stream_cost(c->kind, window_bits, mem_level));
+}
+
+/* wasm_stream_reserve for a stream that allocates bytes besides its context,
+   when it does not use zlib */
+int wasm_stream_reserve_bytes(unsigned zptr, size_t bytes) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c)
+    return Z_STREAM_ERROR;
+  size_t cost = c->size + bytes;
+  size_t reserved = wasm_alloc.reserved - c->reserved;
+  if (wasm_alloc.budget && reserved && reserved + cost > wasm_alloc.budget)
+    return Z_MEM_ERROR;
+  wasm_alloc.reserved = reserved + cost;
+  c->reserved = (unsigned)cost;
+  return Z_OK;
+}
+
+// Set the budget of wasm_stream_reserve, 0 for none. Streams already
+// initialized keep their reservation.
+void wasm_set_budget(unsigned bytes) { wasm_alloc.budget = bytes; }
+
+// Whether a stream other than zptr holds a reservation: when zptr's
+// initialization failed with Z_MEM_ERROR, it may succeed once that one ends.
+// Otherwise the memory is out of reach and waiting would never end.
+int wasm_budget_shared(unsigned zptr) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  return wasm_alloc.reserved != (c ? c->reserved : 0);
+}
+
 unsigned wasm_stream_last_consumed(unsigned zptr) {
   struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
   if (!c)
@@ -40,17 +131,15 @@ int wasm_stream_process_common(unsigned zptr, unsigned in_ptr, unsigned in_len,
   struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
   if (!c)
     return Z_STREAM_ERROR;
-
-  if (in_len > c->inbuf_sz) {
-    unsigned char *nb = (unsigned char *)realloc(c->inbuf, in_len);
-    if (!nb)
-      return Z_MEM_ERROR;
-    c->inbuf = nb;
-    c->inbuf_sz = in_len;
+  if (c->hib) {
+    int r = c->hib->wake(c);
+    if (r != Z_OK)
+      return (r & 0xff) << 24;
   }
 
-  memcpy(c->inbuf, (unsigned char *)(uintptr_t)in_ptr, in_len);
-  c->strm.next_in = c->inbuf;
+  // zlib keeps no pointer to the input between calls: the caller passes the
+  // unconsumed input again, so it can stage it in memory shared by streams.
+  c->strm.next_in = (unsigned char *)(uintptr_t)in_ptr;
   c->strm.avail_in = in_len;
   c->strm.next_out = (unsigned char *)(uintptr_t)out_ptr;
   c->strm.avail_out = out_len;
@@ -61,3 +150,270 @@ int wasm_stream_process_common(unsigned zptr, unsigned in_ptr, unsigned in_len,
   int code = ret & 0xff;
   return (produced & 0x00ffffff) | ((code & 0xff) << 24);
 }
+
+/* Hibernate c: keep the window bytes a then b, raw deflated unless that does
+   not make them smaller, until the next process call runs wake. The caller
+   then frees its big allocations. The memory reservation is kept for wake. */
+int wasm_stream_hibernate(struct wasm_stream_ctx *c, const unsigned char *a,
+                          unsigned alen, const unsigned char *b, unsigned blen,
+                          int (*wake)(struct wasm_stream_ctx *)) {
+  unsigned size = alen + blen, packed = size;
+  size_t header = offsetof(struct wasm_hibernation, data);
+  struct wasm_hibernation *h =
+      (struct wasm_hibernation *)malloc(header + size + 1);
+  if (!h)
+    return Z_MEM_ERROR;
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  z.zalloc = my_zalloc;
+  z.zfree = my_zfree;
+  if (size && deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                           8, Z_DEFAULT_STRATEGY) == Z_OK) {
+    z.next_out = h->data;
+    z.avail_out = size - 1;
+    z.next_in = (Bytef *)a;
+    z.avail_in = alen;
+    int r = deflate(&z, Z_NO_FLUSH);
+    if (r == Z_OK && z.avail_in == 0) {
+      z.next_in = (Bytef *)b;
+      z.avail_in = blen;
+      if (deflate(&z, Z_FINISH) == Z_STREAM_END)
+        packed = (unsigned)z.total_out;
+    }
+    deflateEnd(&z);
+  }
+  if (packed == size) {
+    memcpy(h->data, a, alen);
+    memcpy(h->data + alen, b, blen);
+  } else {
+    struct wasm_hibernation *shrunk =
+        (struct wasm_hibernation *)realloc(h, header + packed);
+    if (shrunk)
+      h = shrunk;
+  }
+  h->wake = wake;
+  h->size = size;
+  h->packed = packed;
+  c->hib = h;
+  wasm_alloc_account((long)(header + packed));
+  return Z_OK;
+}
+
+// Copy the window bytes kept by wasm_stream_hibernate to window, drop them.
+int wasm_stream_restore(struct wasm_stream_ctx *c, unsigned char *window) {
+  struct wasm_hibernation *h = c->hib;
+  int r = Z_OK;
+  if (h->packed == h->size) {
+    memcpy(window, h->data, h->size);
+  } else {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    z.zalloc = my_zalloc;
+    z.zfree = my_zfree;
+    r = inflateInit2(&z, -MAX_WBITS);
+    if (r == Z_OK) {
+      z.next_in = h->data;
+      z.avail_in = h->packed;
+      z.next_out = window;
+      z.avail_out = h->size;
+      r = inflate(&z, Z_FINISH) == Z_STREAM_END && z.avail_out == 0
+              ? Z_OK
+              : Z_DATA_ERROR;
+      inflateEnd(&z);
+    }
+  }
+  wasm_alloc_account(
+      -(long)(offsetof(struct wasm_hibernation, data) + h->packed));
+  free(h);
+  c->hib = NULL;
+  return r;
+}
+
+static int inflate_wake(struct wasm_stream_ctx *c) {
+  struct inflate_state *state = (struct inflate_state *)c->strm.state;
+  unsigned size = c->hib->size;
+  state->window = (unsigned char FAR *)ZALLOC(&c->strm, 2U << state->wbits,
+                                              sizeof(unsigned char));
+  if (state->window == Z_NULL)
+    return Z_MEM_ERROR;
+  state->wsize = 1U << state->wbits;
+  state->whave = size;
+  state->wnext = size;
+  return wasm_stream_restore(c, state->window);
+}
+
+/* Free the window of an inflate or inflate9 stream, keeping its live bytes
+   (whave, which end at wnext), until the next process call, and its table
+   cache. Any point of the stream will do: the window is only read through
+   whave and wnext. */
+int wasm_inflate_hibernate(unsigned zptr) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c || c->strm.state == Z_NULL)
+    return Z_STREAM_ERROR;
+  struct inflate_state *state = (struct inflate_state *)c->strm.state;
+  if (c->hib || state->window == Z_NULL)
+    return Z_OK;
+  if (state->whave) {
+    // the live bytes end at wnext, in one piece
+    int r = wasm_stream_hibernate(
+        c, state->window + state->wnext - state->whave, state->whave,
+        state->window, 0, inflate_wake);
+    if (r != Z_OK)
+      return r;
+  }
+  ZFREE(&c->strm, state->window);
+  state->window = Z_NULL;
+  state->wsize = state->whave = state->wnext = 0;
+#if TABLE_CACHE > 0
+  // the table cache comes back with the next repeated header, unless the
+  // current block decodes with its tables
+  if (state->tables != Z_NULL &&
+      ((char *)state->lencode < (char *)state->tables ||
+       (char *)state->lencode >= (char *)(state->tables + TABLE_CACHE))) {
+    ZFREE(&c->strm, state->tables);
+    state->tables = Z_NULL;
+  }
+#endif
+  return Z_OK;
+}
+
+// Switch c, an inflate or inflate9 stream, initialized and not started, to
+// output ring mode with a ring of size bytes, allocated after the wasm_ring
+// unless data is given
+static struct wasm_ring *ring_new(struct wasm_stream_ctx *c,
+                                  unsigned char *data, unsigned size) {
+  if (!c || c->kind == WASM_STREAM_DEFLATE || c->ring ||
+      c->strm.state == Z_NULL)
+    return NULL;
+  size_t cost = sizeof(struct wasm_ring) + (data ? 0 : size);
+  struct wasm_ring *ring = (struct wasm_ring *)malloc(cost);
+  if (!ring)
+    return NULL;
+  if (inflateRing(&c->strm, 0) != Z_OK) {
+    free(ring);
+    return NULL;
+  }
+  ring->data = data ? data : (unsigned char *)(ring + 1);
+  ring->size = size;
+  ring->pos = ring->out = ring->have = 0;
+  ring->fixed = data != NULL;
+  c->ring = ring;
+  wasm_alloc_account((long)cost);
+  return ring;
+}
+
+/* Switch an inflate or inflate9 stream, initialized and not started, to output
+   ring mode: its output goes to a ring of size bytes, a power of two holding
+   at least two windows, that inflate reads its matches from instead of
+   copying the output to a window of its own (see inflateRing). Returns the
+   address of the ring, or 0. A ring stream has nothing to hibernate. */
+unsigned wasm_inflate_ring(unsigned zptr, unsigned size) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c || c->strm.state == Z_NULL)
+    return 0;
+  struct inflate_state *state = (struct inflate_state *)c->strm.state;
+  // the produced count of a process call takes 24 bits
+  if ((size & (size - 1)) || size < (2U << state->wbits) || size > 1U << 23)
+    return 0;
+  struct wasm_ring *ring = ring_new(c, NULL, size);
+  return ring ? (unsigned)(uintptr_t)ring->data : 0;
+}
+
+/* Like wasm_inflate_ring, with the caller's buffer of out_len bytes in place of
+   the ring, for the whole output of the stream, as the window of infback9 is
+   its output: the process calls decode into it one after the other, and the
+   matches read the output already there, so that nothing is ever copied to a
+   window. Once the buffer is full, the process calls return Z_BUF_ERROR. For
+   entries of ZIP files, whose size is known. */
+int wasm_inflate_back(unsigned zptr, unsigned out_ptr, unsigned out_len) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!out_ptr || !ring_new(c, (unsigned char *)(uintptr_t)out_ptr, out_len))
+    return Z_STREAM_ERROR;
+  return Z_OK;
+}
+
+/* wasm_stream_process_common for a ring stream: the output goes to the ring,
+   from wasm_inflate_ring_out. The ring is a sliding buffer rather than a
+   circular one, so that matches never wrap: when less than a window is left
+   after pos, the last window of output moves to its start first. The buffer
+   of wasm_inflate_back stays in place. */
+int wasm_inflate_ring_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
+                              int flush, int (*process_func)(z_stream *, int)) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c || !c->ring)
+    return Z_STREAM_ERROR;
+  struct wasm_ring *ring = c->ring;
+  struct inflate_state *state = (struct inflate_state *)c->strm.state;
+  unsigned wsize = 1U << state->wbits;
+  if (ring->have > wsize)
+    ring->have = wsize;
+  if (!ring->fixed && ring->size - ring->pos < wsize) {
+    memmove(ring->data, ring->data + ring->pos - ring->have, ring->have);
+    ring->pos = ring->have;
+  }
+  // the matches reach back to the last reset only
+  inflateRing(&c->strm, ring->have);
+  ring->out = ring->pos;
+  // the produced count takes 24 bits
+  unsigned room = ring->size - ring->pos;
+  if (room > 0x00ffffff)
+    room = 0x00ffffff;
+  int r = wasm_stream_process_common(
+      zptr, in_ptr, in_len, (unsigned)(uintptr_t)(ring->data + ring->pos),
+      room, flush, process_func);
+  unsigned produced = (unsigned)r & 0x00ffffff;
+  ring->pos += produced;
+  ring->have = state->behind != ring->have ? (unsigned)c->strm.total_out
+                                           : ring->have + produced;
+  return r;
+}
+
+// Address of the output of the last wasm_inflate_ring_process call
+unsigned wasm_inflate_ring_out(unsigned zptr) {
+  struct wasm_stream_ctx *c = (struct wasm_stream_ctx *)(uintptr_t)zptr;
+  if (!c || !c->ring)
+    return 0;
+  return (unsigned)(uintptr_t)(c->ring->data + c->ring->out);
+}
+
+// Whether the stream has its sliding window: allocated on init by deflate,
+// on the first output by inflate.
+static int has_window(struct wasm_stream_ctx *c) {
+  if (c->strm.state == Z_NULL)
+    return 0;
+  if (c->kind == WASM_STREAM_DEFLATE)
+    return 1;
+  return ((struct inflate_state *)c->strm.state)->window != Z_NULL;
+}
+
+/* Copy the heap telemetry to out_ptr, an array of unsigned: live bytes (zlib
+   allocations and contexts), peak live bytes, bytes held by zlib, live
+   contexts by kind (inflate, inflate9, deflate), live windows, then malloc's
+   free list (free bytes, free chunks), the heap size, the memory size, the
+   bytes reserved by initialized streams and the budget. */
+int wasm_stats(unsigned out_ptr) {
+  unsigned *out = (unsigned *)(uintptr_t)out_ptr;
+  struct wasm_stream_ctx *c;
+  unsigned windows = 0;
+  if (!out)
+    return Z_STREAM_ERROR;
+  memset(out, 0, (4 + WASM_STREAM_KINDS + 6) * sizeof(unsigned));
+  out[0] = (unsigned)wasm_alloc.live;
+  out[1] = (unsigned)wasm_alloc.peak;
+  out[2] = (unsigned)wasm_alloc.zlib;
+  for (c = live_streams; c; c = c->next) {
+    out[3 + c->kind]++;
+    windows += has_window(c);
+  }
+  out[3 + WASM_STREAM_KINDS] = windows;
+  struct mallinfo mi = mallinfo();
+  out[4 + WASM_STREAM_KINDS] = (unsigned)mi.fordblks;
+  out[5 + WASM_STREAM_KINDS] = (unsigned)mi.ordblks;
+  out[6 + WASM_STREAM_KINDS] = (unsigned)mi.arena;
+#ifdef __wasm__
+  out[7 + WASM_STREAM_KINDS] = (unsigned)__builtin_wasm_memory_size(0) * 65536;
+#endif
+  out[8 + WASM_STREAM_KINDS] = (unsigned)wasm_alloc.reserved;
+  out[9 + WASM_STREAM_KINDS] = (unsigned)wasm_alloc.budget;
+  return Z_OK;
+}
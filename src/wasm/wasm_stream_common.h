@@ -1,26 +1,78 @@
 #ifndef WASM_STREAM_COMMON_H
 #define WASM_STREAM_COMMON_H
 
+#include <stddef.h>
 #include "zlib.h"
 #include "allocator.h"
 
-// Common fields for all WASM stream contexts
+// Common fields for all WASM stream contexts. strm must stay first so that a
+// process function handed a z_stream can get back to its context.
 #define WASM_STREAM_COMMON_FIELDS                                              \
   z_stream strm;                                                               \
-  unsigned char *inbuf;                                                        \
-  unsigned inbuf_sz;                                                           \
-  unsigned last_consumed;
+  unsigned last_consumed;                                                      \
+  unsigned kind;                                                               \
+  unsigned size;                                                               \
+  unsigned reserved;                                                           \
+  struct wasm_stream_ctx *prev;                                                \
+  struct wasm_stream_ctx *next;                                                \
+  struct wasm_hibernation *hib;                                                \
+  struct wasm_ring *ring;
+
+// Context kinds, counted separately by wasm_stats
+enum wasm_stream_kind {
+  WASM_STREAM_INFLATE,
+  WASM_STREAM_INFLATE9,
+  WASM_STREAM_DEFLATE,
+  WASM_STREAM_KINDS
+};
 
 struct wasm_stream_ctx {
   WASM_STREAM_COMMON_FIELDS;
 };
 
+// Window bytes kept by a hibernated stream until the next process call, where
+// wake rebuilds what hibernation freed (see wasm_stream_hibernate).
+struct wasm_hibernation {
+  int (*wake)(struct wasm_stream_ctx *c);
+  unsigned size;   /* window bytes */
+  unsigned packed; /* bytes in data: raw deflate, or the window if size */
+  unsigned char data[1];
+};
+
+// Output ring of an inflate or inflate9 stream (see wasm_inflate_ring), or
+// the caller's buffer for the whole output (see wasm_inflate_back): the
+// decoder writes at pos and reads its matches from the bytes before it.
+struct wasm_ring {
+  unsigned char *data;
+  unsigned size;  /* power of two, at least twice the window, or the size of
+                     the caller's buffer */
+  unsigned pos;   /* end of the output */
+  unsigned out;   /* start of the output of the last process call */
+  unsigned have;  /* output since the last reset, up to the window size */
+  int fixed;      /* data is the caller's: never slides */
+};
+
 // Common function declarations
-unsigned wasm_stream_new(void);
+unsigned wasm_stream_new(size_t size, unsigned kind);
 int wasm_stream_end(unsigned zptr, int (*end_func)(z_stream *));
+int wasm_stream_reserve(unsigned zptr, int window_bits, int mem_level);
+int wasm_stream_reserve_bytes(unsigned zptr, size_t bytes);
 unsigned wasm_stream_last_consumed(unsigned zptr);
 int wasm_stream_process_common(unsigned zptr, unsigned in_ptr, unsigned in_len,
                                unsigned out_ptr, unsigned out_len, int flush,
                                int (*process_func)(z_stream *, int));
+int wasm_stream_hibernate(struct wasm_stream_ctx *c, const unsigned char *a,
+                          unsigned alen, const unsigned char *b, unsigned blen,
+                          int (*wake)(struct wasm_stream_ctx *));
+int wasm_stream_restore(struct wasm_stream_ctx *c, unsigned char *window);
+int wasm_inflate_hibernate(unsigned zptr);
+unsigned wasm_inflate_ring(unsigned zptr, unsigned size);
+int wasm_inflate_ring_process(unsigned zptr, unsigned in_ptr, unsigned in_len,
+                              int flush, int (*process_func)(z_stream *, int));
+unsigned wasm_inflate_ring_out(unsigned zptr);
+int wasm_inflate_back(unsigned zptr, unsigned out_ptr, unsigned out_len);
+int wasm_stats(unsigned out_ptr);
+void wasm_set_budget(unsigned bytes);
+int wasm_budget_shared(unsigned zptr);
 
 #endif // WASM_STREAM_COMMON_H
@@ -0,0 +1,389 @@
+/*
+ * bench.c
+ *
+ * Native throughput benchmark for deflate(), inflate() and the deflate64
+ * mode of inflate() (inflateInit2(strm, -16)) over a corpus of files.
+ *
+ * Plain files are compressed with deflate() for every level and window size
+ * requested, then the result is decompressed with inflate(); files ending in
+ * .deflate64 are raw deflate64 streams and are only decompressed. Each case
+ * is run with every input/output buffer size combination. The median of the
+ * runs is reported as CSV, one line per case: throughput in MB/s of
+ * uncompressed data, cycles per uncompressed byte (time stamp counter, x86
+ * only) and the peak of the memory allocated by zlib.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zlib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define MAX_VALUES 16
+
+struct values {
+  int n;
+  long v[MAX_VALUES];
+};
+
+struct sample {
+  double ns;
+  double cycles;
+};
+
+/* allocation hooks tracking the memory allocated by zlib */
+static size_t live_bytes;
+static size_t peak_bytes;
+
+static voidpf bench_alloc(voidpf opaque, unsigned items, unsigned size) {
+  (void)opaque;
+  size_t n = (size_t)items * size;
+  size_t *p = (size_t *)malloc(n + sizeof(size_t) * 2);
+  if (!p)
+    return Z_NULL;
+  p[0] = n;
+  live_bytes += n;
+  if (live_bytes > peak_bytes)
+    peak_bytes = live_bytes;
+  return p + 2;
+}
+
+static void bench_free(voidpf opaque, voidpf ptr) {
+  (void)opaque;
+  size_t *p = (size_t *)ptr - 2;
+  live_bytes -= p[0];
+  free(p);
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double now_cycles(void) {
+#ifdef HAVE_TSC
+  return (double)__rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int parse_values(const char *arg, struct values *values) {
+  char *end;
+  values->n = 0;
+  while (*arg && values->n < MAX_VALUES) {
+    values->v[values->n++] = strtol(arg, &end, 10);
+    if (end == arg || (*end && *end != ','))
+      return -1;
+    arg = *end ? end + 1 : end;
+  }
+  return values->n ? 0 : -1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n) {
+  qsort(v, n, sizeof(double), compare_doubles);
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static unsigned char *read_file(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long sz = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *buf = malloc(sz > 0 ? sz : 1);
+  if (buf && fread(buf, 1, sz, f) != (size_t)sz) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  *size = buf ? (size_t)sz : 0;
+  return buf;
+}
+
+/* Compress src into dst (of size *dst_len) feeding in_buf bytes of input and
+   out_buf bytes of output space per call. */
+static int run_deflate(const unsigned char *src, size_t src_len,
+                       unsigned char *dst, size_t *dst_len, int level,
+                       int wbits, size_t in_buf, size_t out_buf) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  strm.zalloc = bench_alloc;
+  strm.zfree = bench_free;
+  int ret = deflateInit2(&strm, level, Z_DEFLATED, -wbits, 8,
+                         Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK)
+    return ret;
+  size_t in_pos = 0, out_pos = 0;
+  do {
+    size_t in_len = src_len - in_pos < in_buf ? src_len - in_pos : in_buf;
+    int flush = in_pos + in_len == src_len ? Z_FINISH : Z_NO_FLUSH;
+    strm.next_in = (unsigned char *)src + in_pos;
+    strm.avail_in = (unsigned)in_len;
+    do {
+      size_t out_len =
+          *dst_len - out_pos < out_buf ? *dst_len - out_pos : out_buf;
+      strm.next_out = dst + out_pos;
+      strm.avail_out = (unsigned)out_len;
+      ret = deflate(&strm, flush);
+      out_pos += out_len - strm.avail_out;
+    } while (ret == Z_OK && strm.avail_out == 0 && out_pos < *dst_len);
+    in_pos += in_len - strm.avail_in;
+  } while (ret == Z_OK && in_pos < src_len);
+  deflateEnd(&strm);
+  *dst_len = out_pos;
+  return ret == Z_STREAM_END ? Z_OK : Z_BUF_ERROR;
+}
+
+/* Decompress src feeding in_buf bytes of input and out_buf bytes of output
+   space per call. The output is discarded, its size and CRC-32 are returned
+   when check is not NULL. */
+static int run_inflate(const unsigned char *src, size_t src_len, int wbits,
+                       size_t in_buf, unsigned char *out, size_t out_buf,
+                       size_t *out_total, unsigned long *check) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  strm.zalloc = bench_alloc;
+  strm.zfree = bench_free;
+  int ret = inflateInit2(&strm, -wbits);
+  if (ret != Z_OK)
+    return ret;
+  size_t in_pos = 0;
+  if (check)
+    *check = crc32(0, Z_NULL, 0);
+  do {
+    size_t in_len = src_len - in_pos < in_buf ? src_len - in_pos : in_buf;
+    strm.next_in = (unsigned char *)src + in_pos;
+    strm.avail_in = (unsigned)in_len;
+    do {
+      strm.next_out = out;
+      strm.avail_out = (unsigned)out_buf;
+      ret = inflate(&strm, Z_NO_FLUSH);
+      if (check)
+        *check = crc32(*check, out, (unsigned)(out_buf - strm.avail_out));
+    } while (ret == Z_OK && strm.avail_out == 0);
+    in_pos += in_len - strm.avail_in;
+  } while (ret == Z_OK && in_pos < src_len);
+  *out_total = strm.total_out;
+  inflateEnd(&strm);
+  return ret == Z_STREAM_END ? Z_OK : (ret == Z_OK ? Z_BUF_ERROR : ret);
+}
+
+static void report(FILE *csv, const char *op, const char *path, int level,
+                   int wbits, size_t in_buf, size_t out_buf, size_t in_len,
+                   size_t out_len, size_t raw_len, struct sample *samples,
+                   int runs, size_t peak) {
+  double ns[runs], cycles[runs];
+  for (int i = 0; i < runs; i++) {
+    ns[i] = samples[i].ns;
+    cycles[i] = samples[i].cycles;
+  }
+  double median_ns = median(ns, runs);
+  double median_cycles = median(cycles, runs);
+  double mbs = median_ns > 0 ? raw_len / (median_ns / 1e9) / 1e6 : 0;
+  fprintf(csv, "%s,%s,%d,%d,%zu,%zu,%zu,%zu,%d,%.0f,%.2f,", op, path, level,
+          wbits, in_buf, out_buf, in_len, out_len, runs, median_ns, mbs);
+  if (median_cycles > 0 && raw_len)
+    fprintf(csv, "%.3f", median_cycles / raw_len);
+  fprintf(csv, ",%zu\n", peak);
+  fflush(csv);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-n runs] [-l levels] [-w wbits] [-i in_sizes] "
+          "[-u out_sizes] [-o out.csv] file...\n"
+          "  lists are comma separated, e.g. -l 1,6,9 -w 9,15 -i 4096,65536\n"
+          "  files ending in .deflate64 are raw deflate64 streams, only "
+          "decompressed\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  int runs = 5;
+  struct values levels = {3, {1, 6, 9}};
+  struct values wbits = {1, {15}};
+  struct values in_sizes = {2, {16384, 65536}};
+  struct values out_sizes = {2, {16384, 65536}};
+  FILE *csv = stdout;
+  int argi = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; argi += 2) {
+    const char *opt = argv[argi];
+    if (argi + 1 >= argc || opt[1] == 0 || opt[2] != 0) {
+      usage(argv[0]);
+      return 2;
+    }
+    const char *arg = argv[argi + 1];
+    int bad = 0;
+    switch (opt[1]) {
+    case 'n':
+      runs = atoi(arg);
+      bad = runs < 1;
+      break;
+    case 'l':
+      bad = parse_values(arg, &levels);
+      break;
+    case 'w':
+      bad = parse_values(arg, &wbits);
+      break;
+    case 'i':
+      bad = parse_values(arg, &in_sizes);
+      break;
+    case 'u':
+      bad = parse_values(arg, &out_sizes);
+      break;
+    case 'o':
+      csv = fopen(arg, "w");
+      bad = csv == NULL;
+      break;
+    default:
+      bad = 1;
+    }
+    if (bad) {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argi >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  size_t max_out = 0;
+  for (int i = 0; i < out_sizes.n; i++)
+    if ((size_t)out_sizes.v[i] > max_out)
+      max_out = out_sizes.v[i];
+  unsigned char *out = malloc(max_out);
+  struct sample *samples = malloc(sizeof(struct sample) * runs);
+  if (!out || !samples)
+    return 4;
+
+  fprintf(csv, "op,file,level,wbits,in_buf,out_buf,input_bytes,"
+               "output_bytes,runs,median_ns,mb_s,cycles_per_byte,peak_bytes\n");
+  int status = 0;
+  for (; argi < argc; argi++) {
+    const char *path = argv[argi];
+    size_t len;
+    unsigned char *data = read_file(path, &len);
+    if (!data) {
+      status = 3;
+      continue;
+    }
+    size_t path_len = strlen(path);
+    int deflate64 =
+        path_len > 10 && strcmp(path + path_len - 10, ".deflate64") == 0;
+
+    if (deflate64) {
+      /* deflate64 mode of inflate(), the stream is only decompressed */
+      size_t raw_len;
+      unsigned long check;
+      if (run_inflate(data, len, 16, 65536, out, max_out, &raw_len, &check) !=
+          Z_OK) {
+        fprintf(stderr, "%s: invalid deflate64 stream\n", path);
+        status = 1;
+      } else {
+        for (int i = 0; i < in_sizes.n; i++)
+          for (int o = 0; o < out_sizes.n; o++) {
+            size_t peak = 0, total;
+            for (int r = 0; r < runs; r++) {
+              peak_bytes = 0;
+              double t0 = now_ns(), c0 = now_cycles();
+              run_inflate(data, len, 16, in_sizes.v[i], out, out_sizes.v[o],
+                          &total, NULL);
+              samples[r].cycles = now_cycles() - c0;
+              samples[r].ns = now_ns() - t0;
+              if (peak_bytes > peak)
+                peak = peak_bytes;
+            }
+            report(csv, "inflate64", path, -1, 16, in_sizes.v[i],
+                   out_sizes.v[o], len, total, total, samples, runs, peak);
+          }
+      }
+      free(data);
+      continue;
+    }
+
+    size_t bound = deflateBound(NULL, len) + 64;
+    unsigned char *comp = malloc(bound);
+    if (!comp) {
+      free(data);
+      return 4;
+    }
+    for (int l = 0; l < levels.n; l++)
+      for (int w = 0; w < wbits.n; w++) {
+        int level = (int)levels.v[l], bits = (int)wbits.v[w];
+        size_t comp_len = bound;
+        if (run_deflate(data, len, comp, &comp_len, level, bits, 65536,
+                        65536) != Z_OK) {
+          fprintf(stderr, "%s: deflate failed (level %d, wbits %d)\n", path,
+                  level, bits);
+          status = 1;
+          continue;
+        }
+        /* check the round trip once before timing */
+        size_t total;
+        unsigned long check;
+        if (run_inflate(comp, comp_len, bits, 65536, out, max_out, &total,
+                        &check) != Z_OK ||
+            total != len || check != crc32(crc32(0, Z_NULL, 0), data, len)) {
+          fprintf(stderr, "%s: round trip failed (level %d, wbits %d)\n",
+                  path, level, bits);
+          status = 1;
+          continue;
+        }
+        for (int i = 0; i < in_sizes.n; i++)
+          for (int o = 0; o < out_sizes.n; o++) {
+            size_t peak = 0, size = 0;
+            for (int r = 0; r < runs; r++) {
+              size = bound;
+              peak_bytes = 0;
+              double t0 = now_ns(), c0 = now_cycles();
+              run_deflate(data, len, comp, &size, level, bits, in_sizes.v[i],
+                          out_sizes.v[o]);
+              samples[r].cycles = now_cycles() - c0;
+              samples[r].ns = now_ns() - t0;
+              if (peak_bytes > peak)
+                peak = peak_bytes;
+            }
+            report(csv, "deflate", path, level, bits, in_sizes.v[i],
+                   out_sizes.v[o], len, size, len, samples, runs, peak);
+            peak = 0;
+            for (int r = 0; r < runs; r++) {
+              peak_bytes = 0;
+              double t0 = now_ns(), c0 = now_cycles();
+              run_inflate(comp, size, bits, in_sizes.v[i], out,
+                          out_sizes.v[o], &total, NULL);
+              samples[r].cycles = now_cycles() - c0;
+              samples[r].ns = now_ns() - t0;
+              if (peak_bytes > peak)
+                peak = peak_bytes;
+            }
+            report(csv, "inflate", path, level, bits, in_sizes.v[i],
+                   out_sizes.v[o], size, total, total, samples, runs, peak);
+          }
+      }
+    free(comp);
+    free(data);
+  }
+  free(out);
+  free(samples);
+  if (csv != stdout)
+    fclose(csv);
+  return status;
+}